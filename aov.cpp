@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <sstream>
+
+#include "aov.hpp"
+
+
+bool AOVBuffer::parse(const std::string &list, uint32_t &flags) {
+    flags = 0;
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        if (name == "depth")
+            flags |= DEPTH;
+        else if (name == "normal")
+            flags |= NORMAL;
+        else if (name == "albedo")
+            flags |= ALBEDO;
+        else if (name == "objectid")
+            flags |= OBJECT_ID;
+        else if (name == "split")
+            flags |= DIRECT_INDIRECT;
+        else if (name == "lightgroups")
+            flags |= LIGHT_GROUPS;
+        else if (name == "all")
+            flags |= DEPTH | NORMAL | ALBEDO | OBJECT_ID | DIRECT_INDIRECT | LIGHT_GROUPS;
+        else if (!name.empty())
+            return false;
+    }
+    return true;
+}
+
+Vector3f AOVBuffer::getAlbedo(const Intersection &hit) {
+    // specular surfaces, lights and the background count as white
+    if (!hit.happened || hit.material->getType() != DIFFUSE)
+        return Vector3f(1.0f);
+    return hit.material->Kd;
+}
+
+void AOVBuffer::reset(uint32_t _flags, int _width, int _height, const std::vector<std::string> &lightGroups) {
+    flags = _flags;
+    width = _width;
+    height = _height;
+    channels.clear();
+    depthOffset = normalOffset = albedoOffset = objectIdOffset = directOffset = indirectOffset = groupsOffset = -1;
+    groupCount = 0;
+
+    auto addLayer = [this](const std::string &layer, const std::string &names) {
+        int offset = channels.size();
+        for (char name: names)
+            channels.push_back(layer + "." + name);
+        return offset;
+    };
+    if (flags & DEPTH)
+        depthOffset = addLayer("depth", "Z");
+    if (flags & NORMAL)
+        normalOffset = addLayer("normal", "XYZ");
+    if (flags & ALBEDO)
+        albedoOffset = addLayer("albedo", "RGB");
+    if (flags & OBJECT_ID)
+        objectIdOffset = addLayer("objectid", "I");
+    if (flags & DIRECT_INDIRECT) {
+        directOffset = addLayer("direct", "RGB");
+        indirectOffset = addLayer("indirect", "RGB");
+    }
+    if (flags & LIGHT_GROUPS) {
+        groupCount = lightGroups.size();
+        groupsOffset = channels.size();
+        for (const std::string &group: lightGroups)
+            addLayer("light_" + group, "RGB");
+    }
+    channelCount = channels.size();
+    data.assign(size_t(width) * height * channelCount, 0.0f);
+    sampleCounts.assign(size_t(width) * height, 0);
+}
+
+void AOVBuffer::storeHit(uint32_t pixel, const Intersection &hit) {
+    float *values = data.data() + size_t(pixel) * channelCount;
+    if (depthOffset >= 0)
+        values[depthOffset] = hit.happened ? float(hit.distance) : std::numeric_limits<float>::infinity();
+    if (normalOffset >= 0) {
+        Vector3f normal = hit.happened ? hit.normal : Vector3f(0.0f);
+        values[normalOffset] = normal.x, values[normalOffset + 1] = normal.y, values[normalOffset + 2] = normal.z;
+    }
+    if (albedoOffset >= 0) {
+        Vector3f albedo = getAlbedo(hit);
+        values[albedoOffset] = albedo.x, values[albedoOffset + 1] = albedo.y, values[albedoOffset + 2] = albedo.z;
+    }
+    if (objectIdOffset >= 0)
+        values[objectIdOffset] = hit.happened ? float(hit.object->id + 1) : 0.0f;       // 0 is the background
+}
+
+void AOVBuffer::addSplit(uint32_t pixel, const RadianceSplit &split, uint32_t sampleCount) {
+    float *values = data.data() + size_t(pixel) * channelCount;
+    auto add = [values](int offset, const Vector3f &color) {
+        values[offset] += color.x, values[offset + 1] += color.y, values[offset + 2] += color.z;
+    };
+    if (directOffset >= 0) {
+        add(directOffset, split.direct);
+        add(indirectOffset, split.indirect);
+    }
+    for (int g = 0; g < groupCount; ++g)
+        add(groupsOffset + 3 * g, split.groups[g]);
+    sampleCounts[pixel] += sampleCount;
+}
+
+bool AOVBuffer::write(const std::string &filename, const std::vector<Eigen::Vector3f> &beauty,
+                      const std::vector<Eigen::Vector3f> *denoised) const {
+    // channel names of the beauty and the denoised image first, EXR wants the channel list and the pixel data
+    // in alphabetical order
+    std::vector<std::string> names = {"R", "G", "B"};
+    if (denoised != nullptr)
+        names.insert(names.end(), {"denoised.R", "denoised.G", "denoised.B"});
+    int imageCount = names.size();
+    names.insert(names.end(), channels.begin(), channels.end());
+    std::vector<int> order(names.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&names](int a, int b) { return names[a] < names[b]; });
+
+    std::string header;
+    auto putInt = [&header](int32_t value) { header.append(reinterpret_cast<const char *>(&value), 4); };
+    auto putFloat = [&header](float value) { header.append(reinterpret_cast<const char *>(&value), 4); };
+    auto putAttribute = [&](const std::string &name, const std::string &type, int32_t size) {
+        header += name + '\0' + type + '\0';
+        putInt(size);
+    };
+
+    putInt(20000630);       // magic number
+    putInt(2);              // version 2, single part scanline file
+    int32_t channelListSize = 1;
+    for (const std::string &name: names)
+        channelListSize += name.size() + 1 + 16;
+    putAttribute("channels", "chlist", channelListSize);
+    for (int c: order) {
+        header += names[c] + '\0';
+        putInt(2);          // FLOAT
+        putInt(0);          // pLinear and reserved
+        putInt(1);          // x sampling
+        putInt(1);          // y sampling
+    }
+    header += '\0';
+    putAttribute("compression", "compression", 1);
+    header += '\0';         // NO_COMPRESSION
+    for (const char *window: {"dataWindow", "displayWindow"}) {
+        putAttribute(window, "box2i", 16);
+        putInt(0), putInt(0), putInt(width - 1), putInt(height - 1);
+    }
+    putAttribute("lineOrder", "lineOrder", 1);
+    header += '\0';         // INCREASING_Y
+    putAttribute("pixelAspectRatio", "float", 4);
+    putFloat(1.0f);
+    putAttribute("screenWindowCenter", "v2f", 8);
+    putFloat(0.0f), putFloat(0.0f);
+    putAttribute("screenWindowWidth", "float", 4);
+    putFloat(1.0f);
+    header += '\0';
+
+    // offset table, one uncompressed scanline per chunk
+    int32_t lineSize = names.size() * width * sizeof(float);
+    uint64_t offset = header.size() + uint64_t(height) * sizeof(uint64_t);
+    for (int j = 0; j < height; ++j) {
+        header.append(reinterpret_cast<const char *>(&offset), sizeof(offset));
+        offset += 8 + lineSize;
+    }
+
+    // lighting AOVs come after the geometric ones and are sums over samples
+    int lightingOffset = (directOffset >= 0) ? directOffset : (groupsOffset >= 0) ? groupsOffset : channelCount;
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+    file.write(header.data(), header.size());
+    std::vector<float> line(names.size() * width);
+    for (int j = 0; j < height; ++j) {
+        for (uint32_t k = 0; k < order.size(); ++k) {
+            int c = order[k];
+            for (int i = 0; i < width; ++i) {
+                size_t pixel = size_t(j) * width + i;
+                float value;
+                if (c < 3) {
+                    value = beauty[pixel][c];
+                } else if (c < imageCount) {
+                    value = (*denoised)[pixel][c - 3];
+                } else {
+                    int channel = c - imageCount;
+                    value = data[pixel * channelCount + channel];
+                    if (channel >= lightingOffset)
+                        value = sampleCounts[pixel] > 0 ? value / sampleCounts[pixel] : 0.0f;
+                }
+                line[k * width + i] = value;
+            }
+        }
+        int32_t y = j;
+        file.write(reinterpret_cast<const char *>(&y), 4);
+        file.write(reinterpret_cast<const char *>(&lineSize), 4);
+        file.write(reinterpret_cast<const char *>(line.data()), lineSize);
+    }
+    return bool(file);
+}
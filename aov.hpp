@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Eigen>
+
+#include "vector.hpp"
+#include "global.hpp"
+#include "scene.hpp"
+
+
+/*
+AOV implementation
+CORE:
+- arbitrary output variables: depth, normal, albedo, object ID, direct and indirect lighting, one buffer per light group
+- multi-channel OpenEXR output (uncompressed float scanlines) holding the beauty and every enabled AOV
+
+NOTE:
+- the geometric AOVs come from the camera ray hit which all samples of a pixel share anyway,
+  the lighting AOVs from the radiance split of the paths themselves, so no extra rays are cast
+- the lighting AOVs are averaged over their own sample counts, the geometric ones are overwritten by every pass
+- the beauty is never denoised, so direct plus indirect and the light groups sum back to it,
+  the denoised image goes to its own "denoised" layer
+*/
+class AOVBuffer {
+public:
+    enum Flag : uint32_t {
+        DEPTH = 1 << 0,
+        NORMAL = 1 << 1,
+        ALBEDO = 1 << 2,
+        OBJECT_ID = 1 << 3,
+        DIRECT_INDIRECT = 1 << 4,
+        LIGHT_GROUPS = 1 << 5
+    };
+
+private:
+    uint32_t flags = 0;
+    int width = 0, height = 0;
+    int channelCount = 0;
+    std::vector<std::string> channels;              // EXR channel names, "<layer>.<channel>"
+    int depthOffset = -1, normalOffset = -1, albedoOffset = -1, objectIdOffset = -1;
+    int directOffset = -1, indirectOffset = -1, groupsOffset = -1;
+    int groupCount = 0;
+    std::vector<float> data;                        // channelCount floats per pixel
+    std::vector<uint32_t> sampleCounts;             // samples inside the lighting AOVs of each pixel
+
+public:
+    // comma separated list of depth, normal, albedo, objectid, split, lightgroups or all
+    static bool parse(const std::string &list, uint32_t &flags);
+    // what the denoiser and the AOVs treat as the color of a surface
+    static Vector3f getAlbedo(const Intersection &hit);
+
+    void reset(uint32_t _flags, int _width, int _height, const std::vector<std::string> &lightGroups);
+
+    bool isEnabled() const { return flags != 0; }
+    bool isSplit() const { return (flags & (DIRECT_INDIRECT | LIGHT_GROUPS)) != 0; }
+    int getGroupCount() const { return groupCount; }
+
+    void storeHit(uint32_t pixel, const Intersection &hit);
+    // split holds the sum of sampleCount samples
+    void addSplit(uint32_t pixel, const RadianceSplit &split, uint32_t sampleCount);
+
+    // beauty is the linear radiance written as R, G and B, denoised goes to denoised.R, G and B if it is given
+    bool write(const std::string &filename, const std::vector<Eigen::Vector3f> &beauty,
+               const std::vector<Eigen::Vector3f> *denoised = nullptr) const;
+};
@@ -13,6 +13,14 @@ BVH::BVH(std::vector<Object *> _objects, SplitMethod _splitMethod): splitMethod(
     root = recursiveBuild(_objects);
 }
 
+void BVH::release(BVHBuildNode *node) {
+    if (node == nullptr)
+        return;
+    release(node->left);
+    release(node->right);
+    delete node;
+}
+
 BVHBuildNode *BVH::recursiveBuild(std::vector<Object *> objects) {
     BVHBuildNode *node = new BVHBuildNode();
     
@@ -21,16 +29,14 @@ BVHBuildNode *BVH::recursiveBuild(std::vector<Object *> objects) {
         node->object = objects[0];
         node->left = nullptr;
         node->right = nullptr;
-        if (IS_PATH)
-            node->area = objects[0]->getArea();
+        node->area = objects[0]->getArea();
         return node;
     } else if (objects.size() == 2) {
         node->left = recursiveBuild(std::vector<Object *>{objects[0]});
         node->right = recursiveBuild(std::vector<Object *>{objects[1]});
 
         node->boundingBox = unite(node->left->boundingBox, node->right->boundingBox);
-        if (IS_PATH)
-            node->area = node->left->area + node->right->area;
+        node->area = node->left->area + node->right->area;
         return node;
     } else {
         AABB centroidAABB;
@@ -153,8 +159,7 @@ BVHBuildNode *BVH::recursiveBuild(std::vector<Object *> objects) {
         node->right = recursiveBuild(rightObjects);
 
         node->boundingBox = unite(node->left->boundingBox, node->right->boundingBox);
-        if (IS_PATH)
-            node->area = node->left->area + node->right->area;
+        node->area = node->left->area + node->right->area;
     }
 
     return node;
@@ -47,11 +47,13 @@ public:
 
 private:
     const SplitMethod splitMethod;
-    BVHBuildNode *root;
+    BVHBuildNode *root = nullptr;           // nullptr without objects
 
 public:
     BVH(std::vector<Object *> _objects, SplitMethod _splitMethod = SplitMethod::NAIVE);
-    ~BVH() {}
+    BVH(const BVH &) = delete;
+    BVH &operator=(const BVH &) = delete;
+    ~BVH() { release(root); }
 
     Intersection intersect(const Ray &ray) const;
 
@@ -59,6 +61,7 @@ public:
 
 private:
     BVHBuildNode *recursiveBuild(std::vector<Object *> objects);
+    void release(BVHBuildNode *node);       // frees the nodes, the objects belong to the caller
 
     Intersection getIntersection(BVHBuildNode *node, const Ray &ray) const;
 
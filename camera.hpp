@@ -1,5 +1,10 @@
 #pragma once
 
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
 #include "vector.hpp"
 #include "global.hpp"
 #include "ray.hpp"
@@ -10,7 +15,27 @@ Camera implementation
 CORE: 
 - Camera intrinsics and extrinsics
 - ray casting
+- sub-pixel positions drawn from the reconstruction filter (filter importance sampling)
+- camera path (keyframes of eye, front and up)
+
+NOTE:
+- every sample carries the same weight and stays in its own pixel, so tiles remain independent
+- the position comes from the camera dimensions of the sampler, low-discrepancy samplers stratify it
 */
+enum class PixelFilter { BOX, TENT, GAUSSIAN };
+
+inline bool parsePixelFilter(const std::string &name, PixelFilter &filter) {
+    if (name == "box")
+        filter = PixelFilter::BOX;
+    else if (name == "tent")
+        filter = PixelFilter::TENT;
+    else if (name == "gaussian")
+        filter = PixelFilter::GAUSSIAN;
+    else
+        return false;
+    return true;
+}
+
 class Camera {
 public:
     int width = WIDTH;
@@ -18,6 +43,9 @@ public:
     double fov = FOV;
     Vector3f eye;
     Vector3f front, up, right;
+    bool isJitter = IS_JITTER;
+    PixelFilter filter = PixelFilter::BOX;
+    float filterRadius = PIXEL_FILTER_RADIUS;      // in pixels, 3 sigma of the gaussian
 
     Camera(int w, int h, double f, Vector3f _eye, Vector3f _front, Vector3f _up): width(w), height(h), fov(f) {
         eye = _eye;
@@ -25,12 +53,20 @@ public:
         up = _up;
         right = normalize(crossProduct(front, up));
         up = normalize(crossProduct(right, front));
+        parsePixelFilter(PIXEL_FILTER, filter);
+    }
+
+    static bool isValidOrientation(const Vector3f &front, const Vector3f &up) {
+        // normalizing a zero vector or crossing parallel ones would turn every camera ray into NaN
+        float frontLength = front.norm(), upLength = up.norm();
+        return std::isfinite(frontLength) && std::isfinite(upLength) && frontLength > 0 && upLength > 0
+               && crossProduct(front, up).norm() > epsilon * frontLength * upLength;
     }
 
-    Ray generateRay(int x, int y) const {
-        // inverse viewport transformation
-        double x_ = (2.0 * (x + 0.5) / (double)width - 1);
-        double y_ = (1 - 2.0 * (y + 0.5) / (double)height);
+    Ray generateRay(int x, int y, const Vector2f &offset = Vector2f(0.0f, 0.0f)) const {
+        // inverse viewport transformation, offset is measured from the pixel center
+        double x_ = (2.0 * (x + 0.5 + offset.x) / (double)width - 1);
+        double y_ = (1 - 2.0 * (y + 0.5 + offset.y) / (double)height);
         // inverse perspective transformation
         double scale = tan(deg2rad(fov * 0.5));
         double imageAspectRatio = width / (double)height;
@@ -39,4 +75,97 @@ public:
         Vector3f dir = normalize(x_ * right + y_ * up + front);
         return Ray(eye, dir);
     }
+
+    Vector2f samplePixel() const {
+        // offset distributed like the filter, so the plain average of the samples is the filtered pixel
+        float u, v;
+        getRandom2D(u, v);
+        switch (filter) {
+            case PixelFilter::TENT:
+            {
+                auto warp = [](float t) { return (t < 0.5f) ? std::sqrt(2.0f * t) - 1.0f : 1.0f - std::sqrt(2.0f - 2.0f * t); };
+                return Vector2f(filterRadius * warp(u), filterRadius * warp(v));
+            }
+            case PixelFilter::GAUSSIAN:
+            {
+                // Box-Muller
+                float r = filterRadius / 3.0f * std::sqrt(-2.0f * std::log(1.0f - u)), phi = 2.0f * MY_PI * v;
+                return Vector2f(r * std::cos(phi), r * std::sin(phi));
+            }
+            default:
+                return Vector2f(filterRadius * (2.0f * u - 1.0f), filterRadius * (2.0f * v - 1.0f));
+        }
+    }
+};
+
+class CameraPath {
+private:
+    struct Keyframe {
+        int frame;
+        Vector3f eye, front, up;
+    };
+    std::vector<Keyframe> keyframes;            // sorted by frame
+
+public:
+    // image of every frame
+    int width = WIDTH;
+    int height = HEIGHT;
+    double fov = FOV;
+
+    // every line is "<frame> <eye xyz> <front xyz> <up xyz>", '#' starts a comment
+    // fails if any frame, keyframe or interpolated, ends up with a degenerate front and up
+    bool load(const std::string &filename) {
+        std::ifstream file(filename);
+        if (!file)
+            return false;
+        keyframes.clear();
+        std::string line;
+        while (std::getline(file, line)) {
+            line = line.substr(0, line.find('#'));
+            std::istringstream stream(line);
+            Keyframe key;
+            if (!(stream >> key.frame))
+                continue;
+            if (!(stream >> key.eye.x >> key.eye.y >> key.eye.z >> key.front.x >> key.front.y >> key.front.z
+                         >> key.up.x >> key.up.y >> key.up.z))
+                return false;
+            if (!keyframes.empty() && key.frame <= keyframes.back().frame)
+                return false;
+            keyframes.push_back(key);
+        }
+        if (keyframes.empty() || keyframes.front().frame < 0)
+            return false;
+        // the interpolation may still cross a zero or parallel front and up between valid keyframes
+        for (int frame = 0; frame < getFrameCount(); ++frame) {
+            Vector3f eye, front, up;
+            interpolate(frame, eye, front, up);
+            if (!Camera::isValidOrientation(front, up))
+                return false;
+        }
+        return true;
+    }
+
+    int getFrameCount() const { return keyframes.empty() ? 0 : keyframes.back().frame + 1; }
+
+    Camera at(int frame) const {
+        Vector3f eye, front, up;
+        interpolate(frame, eye, front, up);
+        return Camera(width, height, fov, eye, normalize(front), normalize(up));
+    }
+
+private:
+    void interpolate(int frame, Vector3f &eye, Vector3f &front, Vector3f &up) const {
+        // linear interpolation between the surrounding keyframes, the camera orthonormalizes the result
+        uint32_t k = 0;
+        while (k + 1 < keyframes.size() && keyframes[k + 1].frame <= frame)
+            ++k;
+        const Keyframe &a = keyframes[k];
+        if (k + 1 == keyframes.size() || frame <= a.frame) {
+            eye = a.eye, front = a.front, up = a.up;
+            return;
+        }
+        const Keyframe &b = keyframes[k + 1];
+        float t = float(frame - a.frame) / float(b.frame - a.frame);
+        eye = lerp(a.eye, b.eye, t), front = lerp(a.front, b.front, t), up = lerp(a.up, b.up, t);
+    }
 };
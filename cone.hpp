@@ -24,6 +24,8 @@ public:
         cosine = height / std::sqrt(radius * radius + height * height);
     }
 
+    Object *clone() const override { return new Cone(*this); }
+
     AABB getBoundingBox() override {
         Vector3f p1 = center + height * direction;
         Vector3f p2 = center;
@@ -91,16 +93,18 @@ public:
 
     void sample(Intersection &position, float &pdf) override {
         float p = getRandomFloat() * area;
+        float u, v;
+        getRandom2D(u, v);
         if (p < MY_PI * radius * radius) {
             // circle
-            float theta = 2.0 * MY_PI * getRandomFloat();
-            float r = radius * std::sqrt(getRandomFloat());
+            float theta = 2.0 * MY_PI * u;
+            float r = radius * std::sqrt(v);
             position.coordinate = center + r * toWorld(Vector3f(cos(theta), sin(theta), 0), -direction);
             position.normal = -direction;
         } else {
             // cone
-            float theta = 2.0 * MY_PI * getRandomFloat();
-            float l = std::sqrt(height * height + radius * radius) * std::sqrt(getRandomFloat());
+            float theta = 2.0 * MY_PI * u;
+            float l = std::sqrt(height * height + radius * radius) * std::sqrt(v);
             Vector3f cPrime = center + height * direction - l * cosine * direction;
             float rPrime = radius * l / std::sqrt(height * height + radius * radius);
             position.coordinate = cPrime + rPrime * toWorld(Vector3f(cos(theta), sin(theta), 0), direction);
@@ -0,0 +1,280 @@
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include "config.hpp"
+#include "sphere.hpp"
+#include "cylinder.hpp"
+#include "cone.hpp"
+#include "triangle.hpp"
+
+
+Config::Config() {
+    materials = {
+        {"white", Material(DIFFUSE, Vector3f(WHITE_KA_R, WHITE_KA_G, WHITE_KA_B), Vector3f(WHITE_KD_R, WHITE_KD_G, WHITE_KD_B),
+                           Vector3f(WHITE_KS_R, WHITE_KS_G, WHITE_KS_B), WHITE_SE)},
+        {"red", Material(DIFFUSE, Vector3f(RED_KA_R, RED_KA_G, RED_KA_B), Vector3f(RED_KD_R, RED_KD_G, RED_KD_B),
+                         Vector3f(RED_KS_R, RED_KS_G, RED_KS_B), RED_SE)},
+        {"green", Material(DIFFUSE, Vector3f(GREEN_KA_R, GREEN_KA_G, GREEN_KA_B), Vector3f(GREEN_KD_R, GREEN_KD_G, GREEN_KD_B),
+                           Vector3f(GREEN_KS_R, GREEN_KS_G, GREEN_KS_B), GREEN_SE)},
+        {"mirror", Material(REFLECTION)},
+        {"glass", Material(REFRACTION, REFRACTION_IOR)},
+        {"fresnel", Material(REFLECTION_AND_REFRACTION, REFLECTION_REFRACTION_IOR)},
+        {"light", Material(EMISSION, Vector3f(LIGHT_INTENSITY_R1, LIGHT_INTENSITY_G1, LIGHT_INTENSITY_B1))}
+    };
+
+    auto mesh = [](const std::string &filename, const std::string &material, const std::string &name) {
+        ObjectDescription object;
+        object.shape = ObjectDescription::MESH;
+        object.filename = filename;
+        object.material = material;
+        object.name = name;
+        return object;
+    };
+    auto quadric = [](ObjectDescription::Shape shape, const Vector3f &center, const Vector3f &axis, float radius, float height,
+                      const std::string &material, const std::string &name) {
+        ObjectDescription object;
+        object.shape = shape;
+        object.center = center;
+        object.axis = axis;
+        object.radius = radius;
+        object.height = height;
+        object.material = material;
+        object.name = name;
+        return object;
+    };
+    objects = {
+        mesh(CORNELLBOX_FLOOR_OBJ, "white", "floor"),
+        mesh(CORNELLBOX_LEFTWALL_OBJ, "red", "left"),
+        mesh(CORNELLBOX_RIGHTWALL_OBJ, "green", "right"),
+        mesh(CORNELLBOX_SHORTBOX_OBJ, "fresnel", "shortbox"),
+        mesh(CORNELLBOX_TALLBOX_OBJ, "mirror", "tallbox"),
+        quadric(ObjectDescription::SPHERE, Vector3f(SPHERE_POS_X, SPHERE_POS_Y, SPHERE_POS_Z), Vector3f(0.0f),
+                SPHERE_RADIUS, 0.0f, "glass", "sphere"),
+        quadric(ObjectDescription::CYLINDER, Vector3f(CYLINDER_POS_X, CYLINDER_POS_Y, CYLINDER_POS_Z),
+                Vector3f(CYLINDER_DIR_X, CYLINDER_DIR_Y, CYLINDER_DIR_Z), CYLINDER_RADIUS, CYLINDER_HEIGHT, "white", "cylinder"),
+        quadric(ObjectDescription::CONE, Vector3f(CONE_POS_X, CONE_POS_Y, CONE_POS_Z),
+                Vector3f(CONE_DIR_X, CONE_DIR_Y, CONE_DIR_Z), CONE_RADIUS, CONE_HEIGHT, "white", "cone"),
+        mesh(CORNELLBOX_LIGHT_OBJ, "light", "light1")
+    };
+
+    lights = {
+        Light(Vector3f(LIGHT_POX_X2, LIGHT_POX_Y2, LIGHT_POX_Z2), Vector3f(LIGHT_INTENSITY_R2, LIGHT_INTENSITY_G2, LIGHT_INTENSITY_B2))
+    };
+}
+
+bool Config::load(const std::string &filename, std::string &error) {
+    std::ifstream file(filename);
+    if (!file) {
+        error = "cannot read " + filename;
+        return false;
+    }
+    materials.clear();
+    objects.clear();
+    lights.clear();
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        if (!parse(line, error)) {
+            error = filename + ":" + std::to_string(number) + ": " + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Config::parse(const std::string &statement, std::string &error) {
+    std::istringstream stream(statement.substr(0, statement.find('#')));
+    std::string key;
+    if (!(stream >> key))
+        return true;
+    auto readVector = [&stream](Vector3f &v) { return bool(stream >> v.x >> v.y >> v.z); };
+    // the name of an object is optional and defaults to its shape
+    auto readObject = [&](ObjectDescription &object) {
+        if (!(stream >> object.material))
+            return false;
+        if (!(stream >> object.name))
+            object.name = key;
+        return true;
+    };
+
+    bool isValid = true;
+    std::string name;
+    if (key == "width") {
+        isValid = (stream >> width) && width > 0;
+    } else if (key == "height") {
+        isValid = (stream >> height) && height > 0;
+    } else if (key == "spp") {
+        isValid = (stream >> samples) && samples > 0;
+    } else if (key == "integrator") {
+        isValid = (stream >> name) && RayTracer::parseIntegrator(name, integrator);
+    } else if (key == "max_depth") {
+        isValid = (stream >> maxDepth) && maxDepth >= 0;
+    } else if (key == "accelerator") {
+        isValid = (stream >> name) && (name == "bvh" || name == "linear");
+        isBVH = name == "bvh";
+    } else if (key == "threads") {
+        isValid = (stream >> threadsX >> threadsY) && threadsX > 0 && threadsY > 0;
+    } else if (key == "sampler") {
+        isValid = (stream >> name) && Sampler::parseType(name, sampler);
+    } else if (key == "output") {
+        isValid = bool(stream >> filename);
+    } else if (key == "background") {
+        isValid = readVector(background);
+    } else if (key == "ambient") {
+        isValid = readVector(ambient);
+    } else if (key == "camera") {
+        isValid = readVector(eye) && readVector(front) && readVector(up) && (stream >> fov) && fov > 0 && fov < 180;
+    } else if (key == "material") {
+        MaterialDescription material;
+        std::string type;
+        isValid = bool(stream >> material.name >> type);
+        if (type == "diffuse") {
+            material.material = Material(DIFFUSE);
+            isValid = isValid && readVector(material.material.Ka) && readVector(material.material.Kd)
+                              && readVector(material.material.Ks) && (stream >> material.material.specularExponent);
+        } else if (type == "reflection") {
+            material.material = Material(REFLECTION);
+        } else if (type == "refraction" || type == "fresnel") {
+            material.material = Material((type == "refraction") ? REFRACTION : REFLECTION_AND_REFRACTION);
+            isValid = isValid && (stream >> material.material.ior) && material.material.ior > 0;
+        } else if (type == "emission") {
+            material.material = Material(EMISSION);
+            isValid = isValid && readVector(material.material.intensity);
+        } else {
+            isValid = false;
+        }
+        if (isValid)
+            materials.push_back(material);
+    } else if (key == "mesh" || key == "sphere" || key == "cylinder" || key == "cone") {
+        ObjectDescription object;
+        if (key == "mesh") {
+            object.shape = ObjectDescription::MESH;
+            isValid = (stream >> object.filename) && readObject(object);
+        } else if (key == "sphere") {
+            object.shape = ObjectDescription::SPHERE;
+            isValid = readVector(object.center) && (stream >> object.radius) && object.radius > 0 && readObject(object);
+        } else {
+            object.shape = (key == "cylinder") ? ObjectDescription::CYLINDER : ObjectDescription::CONE;
+            isValid = readVector(object.center) && readVector(object.axis) && (stream >> object.radius >> object.height)
+                      && object.radius > 0 && object.height > 0 && readObject(object);
+        }
+        if (isValid && findMaterial(object.material) == nullptr) {
+            error = "unknown material " + object.material;
+            return false;
+        }
+        if (isValid)
+            objects.push_back(object);
+    } else if (key == "light") {
+        Vector3f position, intensity;
+        isValid = readVector(position) && readVector(intensity);
+        if (isValid)
+            lights.emplace_back(position, intensity);
+    } else {
+        error = "unknown statement " + key;
+        return false;
+    }
+
+    // nothing may follow the arguments
+    std::string rest;
+    if (!isValid || (stream >> rest)) {
+        error = "invalid " + key + " statement";
+        return false;
+    }
+    return true;
+}
+
+uint32_t Config::getHash() const {
+    std::ostringstream description;
+    description.precision(9);
+    auto vector = [&description](const Vector3f &v) { description << v.x << ' ' << v.y << ' ' << v.z << ' '; };
+    description << width << ' ' << height << ' ' << int(integrator) << ' ' << maxDepth << ' '
+                << Sampler::getTypeName(sampler) << ' ' << RANDOM_SEED << ' ' << IS_JITTER << ' ' << PIXEL_FILTER << ' ';
+    description << fov << ' ';
+    vector(eye), vector(front), vector(up), vector(background), vector(ambient);
+    for (const ObjectDescription &object: objects) {
+        const Material &material = findMaterial(object.material)->material;
+        description << int(object.shape) << ' ' << object.filename << ' ' << object.radius << ' ' << object.height << ' ';
+        vector(object.center), vector(object.axis);
+        // only the parameters of its type are set
+        description << int(material.getType()) << ' ';
+        switch (material.getType()) {
+            case DIFFUSE: vector(material.Ka), vector(material.Kd), vector(material.Ks), description << material.specularExponent << ' '; break;
+            case REFRACTION:
+            case REFLECTION_AND_REFRACTION: description << material.ior << ' '; break;
+            case EMISSION: vector(material.intensity); break;
+            default: break;
+        }
+    }
+    for (const Light &light: lights)
+        vector(light.position), vector(light.intensity);
+
+    uint32_t hash = 2166136261u;
+    for (char c: description.str())
+        hash = (hash ^ uint8_t(c)) * 16777619u;
+    return hash;
+}
+
+void Config::configure(RayTracer &tracer) const {
+    tracer.setIntegrator(integrator);
+    tracer.setSamples(getSamples());
+    tracer.setThreads(threadsX, threadsY);
+    tracer.setConfigHash(getHash());
+}
+
+bool Config::buildScene(Scene &scene, std::string &error) const {
+    if (!Camera::isValidOrientation(front, up)) {
+        error = "camera front and up have to be non-zero and not parallel";
+        return false;
+    }
+
+    scene.setBackground(background);
+    scene.setAmbient(ambient);
+    scene.setMaxDepth(maxDepth);
+
+    for (const ObjectDescription &object: objects) {
+        // every object gets its own copy, a description may be built into several scenes
+        Material *material = scene.add(std::unique_ptr<Material>(new Material(findMaterial(object.material)->material)));
+        switch (object.shape) {
+            case ObjectDescription::MESH:
+            {
+                try {
+                    scene.add(std::unique_ptr<Object>(new MeshTriangle(object.filename, material, object.name)));
+                } catch (const std::runtime_error &exception) {
+                    error = exception.what();
+                    return false;
+                }
+            } break;
+            case ObjectDescription::SPHERE:
+            {
+                scene.add(std::unique_ptr<Object>(new Sphere(object.center, object.radius, material, object.name)));
+            } break;
+            case ObjectDescription::CYLINDER:
+            {
+                scene.add(std::unique_ptr<Object>(new Cylinder(object.center, normalize(object.axis), object.radius, object.height,
+                                                               material, object.name)));
+            } break;
+            case ObjectDescription::CONE:
+            {
+                scene.add(std::unique_ptr<Object>(new Cone(object.center, normalize(object.axis), object.radius, object.height,
+                                                           material, object.name)));
+            } break;
+        }
+    }
+    for (const Light &light: lights)
+        scene.add(std::unique_ptr<Light>(new Light(light)));
+
+    // accelerate
+    if (isBVH)
+        scene.buildBVH();
+    scene.buildVPLs();
+    return true;
+}
+
+const Config::MaterialDescription *Config::findMaterial(const std::string &name) const {
+    // the latest declaration wins like for every other setting
+    for (auto material = materials.rbegin(); material != materials.rend(); ++material)
+        if (material->name == name)
+            return &*material;
+    return nullptr;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "vector.hpp"
+#include "global.hpp"
+#include "scene.hpp"
+#include "camera.hpp"
+#include "raytracer.hpp"
+#include "material.hpp"
+#include "light.hpp"
+#include "sampler.hpp"
+
+
+/*
+Config implementation
+CORE:
+- render settings, camera and scene description given at runtime, one binary serves every experiment
+- the macros of global.hpp stay the defaults, without a file they describe the built-in Cornell box
+
+NOTE:
+- one statement per line, '#' starts a comment, a later statement overrides an earlier setting, e.g.
+    width 512
+    height 512
+    spp 64                          # samples per pixel, Whitted-style ray tracing defaults to 1
+    integrator path                 # whitted, path or wavefront
+    max_depth 16
+    accelerator bvh                 # bvh or linear
+    threads 8 8                     # grid of worker threads, 1 1 renders on the calling thread
+    sampler sobol                   # random, sobol, halton or bluenoise
+    output output.png
+    background 0 0 0
+    ambient 0 0 0
+    camera <eye xyz> <front xyz> <up xyz> <fov>
+    material <name> diffuse <ka rgb> <kd rgb> <ks rgb> <specular exponent>
+    material <name> reflection
+    material <name> refraction <ior>
+    material <name> fresnel <ior>
+    material <name> emission <intensity rgb>
+    mesh <obj file> <material> [name]
+    sphere <center xyz> <radius> <material> [name]
+    cylinder <center xyz> <axis xyz> <radius> <height> <material> [name]
+    cone <center xyz> <axis xyz> <radius> <height> <material> [name]
+    light <position xyz> <intensity rgb>
+- materials have to be declared before the objects using them
+- a scene may do without emitting objects or without point lights, the path tracer samples whichever there are
+- the settings are applied once before rendering, the hot paths stay the template specialized integrators
+*/
+class Config {
+public:
+    struct MaterialDescription {
+        std::string name;
+        Material material;
+    };
+
+    struct ObjectDescription {
+        enum Shape { MESH, SPHERE, CYLINDER, CONE };
+        Shape shape;
+        std::string filename;           // only needed by meshes
+        Vector3f center, axis;
+        float radius = 0.0f, height = 0.0f;
+        std::string material, name;
+    };
+
+    // render settings
+    int width = WIDTH, height = HEIGHT;
+    uint32_t samples = 0;               // 0 takes the default of the integrator
+    RayTracer::Integrator integrator = IS_PATH ? (IS_WAVEFRONT ? RayTracer::Integrator::WAVEFRONT : RayTracer::Integrator::PATH)
+                                               : RayTracer::Integrator::WHITTED;
+    int maxDepth = MAX_DEPTH;
+    bool isBVH = IS_BVH;
+    int threadsX = IS_MULTITHREADING ? THREADS_X : 1, threadsY = IS_MULTITHREADING ? THREADS_Y : 1;
+    Sampler::Type sampler = Sampler::getType();
+    std::string filename = FILENAME;
+
+    // camera
+    double fov = FOV;
+    Vector3f eye = Vector3f(EYE_POS_X, EYE_POS_Y, EYE_POS_Z);
+    Vector3f front = Vector3f(EYE_FRONT_X, EYE_FRONT_Y, EYE_FRONT_Z);
+    Vector3f up = Vector3f(EYE_UP_X, EYE_UP_Y, EYE_UP_Z);
+
+    // scene
+    Vector3f background = Vector3f(BACKGROUND_R, BACKGROUND_G, BACKGROUND_B);
+    Vector3f ambient = Vector3f(AMBIENT_R, AMBIENT_G, AMBIENT_B);
+    std::vector<MaterialDescription> materials;
+    std::vector<ObjectDescription> objects;
+    std::vector<Light> lights;
+
+public:
+    // the built-in Cornell box
+    Config();
+
+    // the scene of the file replaces the current one, the settings it leaves out keep their values
+    bool load(const std::string &filename, std::string &error);
+    // apply one statement, e.g. "spp 64" from the command line
+    bool parse(const std::string &statement, std::string &error);
+
+    uint32_t getSamples() const { return (samples > 0) ? samples : (integrator == RayTracer::Integrator::WHITTED) ? 1 : PATH_SAMPLES; }
+    Camera getCamera() const { return Camera(width, height, fov, eye, normalize(front), normalize(up)); }
+    // FNV-1a of every setting which changes the rendered radiance, resumed checkpoints and merged partial results
+    // have to match it, mesh files are only identified by their names
+    uint32_t getHash() const;
+    void configure(RayTracer &tracer) const;
+    // create the objects owned by the scene, build its accelerators and the virtual point lights
+    bool buildScene(Scene &scene, std::string &error) const;
+
+private:
+    const MaterialDescription *findMaterial(const std::string &name) const;
+};
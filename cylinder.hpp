@@ -22,6 +22,8 @@ public:
         area = 2 * MY_PI * radius * radius + 2 * MY_PI * radius * height;
     }
 
+    Object *clone() const override { return new Cylinder(*this); }
+
     AABB getBoundingBox() override {
         Vector3f p1 = center + height / 2.0 * direction;
         Vector3f p2 = center - height / 2.0 * direction;
@@ -98,22 +100,24 @@ public:
 
     void sample(Intersection &position, float &pdf) override {
         float p = getRandomFloat() * area;
+        float u, v;
+        getRandom2D(u, v);
         if (p < MY_PI * radius * radius) {
             // first circle
-            float theta = 2.0 * MY_PI * getRandomFloat();
-            float r = radius * std::sqrt(getRandomFloat());
+            float theta = 2.0 * MY_PI * u;
+            float r = radius * std::sqrt(v);
             position.coordinate = center + height / 2.0 * direction + r * toWorld(Vector3f(cos(theta), sin(theta), 0), direction);
             position.normal = direction;
         } else if (p < 2 * MY_PI * radius * radius) {
             // second circle
-            float theta = 2.0 * MY_PI * getRandomFloat();
-            float r = radius * std::sqrt(getRandomFloat());
+            float theta = 2.0 * MY_PI * u;
+            float r = radius * std::sqrt(v);
             position.coordinate = center - height / 2.0 * direction + r * toWorld(Vector3f(cos(theta), sin(theta), 0), -direction);
             position.normal = -direction;
         } else {
             // cylinder
-            float theta = 2.0 * MY_PI * getRandomFloat();
-            float h = height * getRandomFloat() - height / 2.0;
+            float theta = 2.0 * MY_PI * u;
+            float h = height * v - height / 2.0;
             position.coordinate = center + h * direction + radius * toWorld(Vector3f(cos(theta), sin(theta), 0), direction);
             position.normal = toWorld(Vector3f(cos(theta), sin(theta), 0), direction);
         }
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "denoiser.hpp"
+
+
+// 1D B3 spline, the 5x5 kernel is its outer product
+static const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+// albedo below this is not divided out, black surfaces would blow up the irradiance
+static const float minAlbedo = 0.01f;
+
+
+Denoiser::Denoiser(int _width, int _height, const std::vector<Eigen::Vector3f> &albedo,
+                   const std::vector<Eigen::Vector3f> &normal, const std::vector<float> &_depth, int _threadCount)
+    : width(_width), height(_height), threadCount(std::max(1, std::min(_threadCount, _height))), depth(_depth) {
+    int size = width * height;
+    albedoR.resize(size), albedoG.resize(size), albedoB.resize(size);
+    normalX.resize(size), normalY.resize(size), normalZ.resize(size);
+    for (int p = 0; p < size; ++p) {
+        albedoR[p] = std::max(albedo[p].x(), minAlbedo);
+        albedoG[p] = std::max(albedo[p].y(), minAlbedo);
+        albedoB[p] = std::max(albedo[p].z(), minAlbedo);
+        normalX[p] = normal[p].x(), normalY[p] = normal[p].y(), normalZ[p] = normal[p].z();
+    }
+}
+
+void Denoiser::denoise(std::vector<Eigen::Vector3f> &radiance) {
+    int size = width * height;
+    colorR.resize(size), colorG.resize(size), colorB.resize(size);
+    nextR.resize(size), nextG.resize(size), nextB.resize(size);
+    for (int p = 0; p < size; ++p) {
+        colorR[p] = radiance[p].x() / albedoR[p];
+        colorG[p] = radiance[p].y() / albedoG[p];
+        colorB[p] = radiance[p].z() / albedoB[p];
+    }
+
+    int rowsPerThread = (height + threadCount - 1) / threadCount;
+    float colorSigma = DENOISE_SIGMA_COLOR;
+    for (int iteration = 0; iteration < DENOISE_ITERATIONS; ++iteration) {
+        std::vector<std::thread> myThreads;
+        for (int rowBegin = 0; rowBegin < height; rowBegin += rowsPerThread)
+            myThreads.emplace_back(&Denoiser::filterRows, this, rowBegin, std::min(rowBegin + rowsPerThread, height),
+                                   1 << iteration, colorSigma);
+        for (auto &thread: myThreads)
+            thread.join();
+        std::swap(colorR, nextR), std::swap(colorG, nextG), std::swap(colorB, nextB);
+        // finer levels already removed most of the noise, later ones stop at smaller color differences
+        colorSigma *= 0.5f;
+    }
+
+    for (int p = 0; p < size; ++p)
+        radiance[p] = Eigen::Vector3f(colorR[p] * albedoR[p], colorG[p] * albedoG[p], colorB[p] * albedoB[p]);
+}
+
+void Denoiser::filterRows(int rowBegin, int rowEnd, int step, float colorSigma) {
+    float colorWeight = 1.0f / (colorSigma * colorSigma);
+    float normalWeight = 1.0f / (DENOISE_SIGMA_NORMAL * DENOISE_SIGMA_NORMAL);
+    float depthWeight = 1.0f / DENOISE_SIGMA_DEPTH;
+
+    // tap columns of every pixel of a row clamped to the image once, the same for all rows
+    std::vector<int> columns[5];
+    for (int t = 0; t < 5; ++t) {
+        columns[t].resize(width);
+        for (int i = 0; i < width; ++i)
+            columns[t][i] = std::min(std::max(i + (t - 2) * step, 0), width - 1);
+    }
+    std::vector<float> sumR(width), sumG(width), sumB(width), sumWeight(width);
+
+    for (int j = rowBegin; j < rowEnd; ++j) {
+        const int row = j * width;
+        std::fill(sumR.begin(), sumR.end(), 0.0f);
+        std::fill(sumG.begin(), sumG.end(), 0.0f);
+        std::fill(sumB.begin(), sumB.end(), 0.0f);
+        std::fill(sumWeight.begin(), sumWeight.end(), 0.0f);
+
+        for (int v = 0; v < 5; ++v) {
+            const int tapRow = std::min(std::max(j + (v - 2) * step, 0), height - 1) * width;
+            for (int u = 0; u < 5; ++u) {
+                const float h = kernel[u] * kernel[v];
+                const int *tapColumn = columns[u].data();
+                for (int i = 0; i < width; ++i) {
+                    const int p = row + i, q = tapRow + tapColumn[i];
+                    float dr = colorR[p] - colorR[q], dg = colorG[p] - colorG[q], db = colorB[p] - colorB[q];
+                    float dx = normalX[p] - normalX[q], dy = normalY[p] - normalY[q], dz = normalZ[p] - normalZ[q];
+                    float dd = std::abs(depth[p] - depth[q]) / std::max(depth[p], 1e-4f);
+                    float w = h * std::exp(-(dr * dr + dg * dg + db * db) * colorWeight
+                                           - (dx * dx + dy * dy + dz * dz) * normalWeight
+                                           - dd * depthWeight);
+                    sumR[i] += w * colorR[q];
+                    sumG[i] += w * colorG[q];
+                    sumB[i] += w * colorB[q];
+                    sumWeight[i] += w;
+                }
+            }
+        }
+
+        // the center tap always has full weight, so the sum is never zero
+        for (int i = 0; i < width; ++i) {
+            nextR[row + i] = sumR[i] / sumWeight[i];
+            nextG[row + i] = sumG[i] / sumWeight[i];
+            nextB[row + i] = sumB[i] / sumWeight[i];
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include <eigen3/Eigen/Eigen>
+
+#include "vector.hpp"
+#include "global.hpp"
+
+
+/*
+Denoiser implementation
+CORE:
+- edge-avoiding A-Trous wavelet filter (5x5 B3 spline kernel, the taps spread twice as far every iteration)
+- edge stopping on color, normal and relative depth of the first hit
+- albedo demodulation (the irradiance is filtered, the albedo is multiplied back afterwards)
+
+NOTE:
+- buffers are stored channel by channel and every pass is a branch-free loop along rows split among threads,
+  so the inner loop only reads contiguous floats
+*/
+class Denoiser {
+private:
+    int width, height;
+    int threadCount;
+    std::vector<float> colorR, colorG, colorB;          // irradiance being filtered
+    std::vector<float> nextR, nextG, nextB;             // output of the current iteration
+    std::vector<float> albedoR, albedoG, albedoB;
+    std::vector<float> normalX, normalY, normalZ;
+    std::vector<float> depth;
+
+public:
+    Denoiser(int _width, int _height, const std::vector<Eigen::Vector3f> &albedo,
+             const std::vector<Eigen::Vector3f> &normal, const std::vector<float> &_depth,
+             int _threadCount = IS_MULTITHREADING ? THREADS_X * THREADS_Y : 1);
+
+    // radiance is row-major linear radiance, filtered in place
+    void denoise(std::vector<Eigen::Vector3f> &radiance);
+
+private:
+    void filterRows(int rowBegin, int rowEnd, int step, float colorSigma);
+};
@@ -2,7 +2,11 @@
 
 #include <iostream>
 #include <cmath>
-#include <random>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#include "sampler.hpp"
 
 
 constexpr double MY_PI = 3.1415926535;
@@ -17,13 +21,60 @@ constexpr double epsilon2 = 0.01;
 #define CORNELLBOX_SHORTBOX_OBJ "../models/cornellbox/shortbox.obj"
 #define CORNELLBOX_TALLBOX_OBJ "../models/cornellbox/tallbox.obj"
 #define CORNELLBOX_LIGHT_OBJ "../models/cornellbox/light.obj"
+#define OBJ_CHUNK_SIZE 1048576   // bytes of an OBJ file parsed by one thread, smaller files are parsed by the calling thread
 
 #define IS_PATH true
 #define PATH_SAMPLES 32
+#define IS_PROGRESSIVE false
+#define PROGRESSIVE_PASS_SAMPLES 4
+#define PROGRESSIVE_TARGET_SAMPLES 1024
+#define PROGRESSIVE_WRITE_INTERVAL 4
+#define PROGRESSIVE_CHECKPOINT_INTERVAL 1
+#define CHECKPOINT_FILENAME "output.ckpt"
+#define IS_ADAPTIVE false
+#define ADAPTIVE_BASE_SAMPLES 16
+#define ADAPTIVE_PASS_SAMPLES 16
+#define ADAPTIVE_MAX_SAMPLES 1024
+#define ADAPTIVE_THRESHOLD 0.1
+#define ADAPTIVE_MIN_LUMINANCE 0.01
+#define ADAPTIVE_TILE_SIZE 8
+#define IS_TIMED false
+#define TIME_BUDGET_SECONDS 60   // the first pass of one sample per pixel always completes, even past the budget
+#define TIMED_PASS_SAMPLES 4
+#define DISTRIBUTED_TILE_SIZE 64
+#define IS_STREAMING false
+#define STREAMING_TILE_SIZE 64
+#define STREAMING_FLOAT_FILENAME "output.pfm"
+#define STREAMING_FILENAME "output.ppm"
+#define OUTPUT_THREADS 2
+#define OUTPUT_QUEUE_SIZE 2
+#define SEQUENCE_TILE_SIZE 32
+#define SEQUENCE_FRAMES_IN_FLIGHT 2
+#define SEQUENCE_FILENAME "frame_%04d.png"
+#define NUMA_POLICY "none"   // none, first-touch, interleaved or replicated
+#define SERVER_TILE_SIZE 32
+#define SERVER_MAX_JOBS 4
+#define IS_DENOISE false
+#define DENOISE_ITERATIONS 5
+#define DENOISE_SIGMA_COLOR 0.6
+#define DENOISE_SIGMA_NORMAL 0.3
+#define DENOISE_SIGMA_DEPTH 0.1
+#define AOV_LIST ""
+#define AOV_FILENAME "output.exr"
 #define PATH_RR 0.8
+#define IS_WAVEFRONT false
+#define WAVEFRONT_SIZE 65536   // paths in flight over all threads
+#define RANDOM_SEED 0
+#define SAMPLER "sobol"    // random, sobol, halton or bluenoise
+#define IS_JITTER true
+#define PIXEL_FILTER "tent"   // box, tent or gaussian
+#define PIXEL_FILTER_RADIUS 1.0
 #define IS_MULTITHREADING true
 #define THREADS_X 8
 #define THREADS_Y 8
+#define PROGRESS_INTERVAL_MS 500
+#define IS_PROGRESS_JSON false
+#define PROGRESS_JSON_FILENAME "progress.jsonl"
 #define IS_BVH true
 #define IS_SAH true
 #define SAH_BUCKET_COUNT 12
@@ -34,11 +85,13 @@ constexpr double epsilon2 = 0.01;
 #define GAMMA_VALUE_G 0.6
 #define GAMMA_VALUE_B 0.6
 #define AREA2POINT_NUM 16
+#define AREA2POINT_SETS 1   // sets of virtual point lights per emitter, sample indices and sequence frames cycle through them
 #define POINT_LIGHT_RATIO 0.1
 #define WIDTH 1024
 #define HEIGHT 1024
 #define FOV 40
 #define MAX_DEPTH 16
+#define WHITTED_MIN_WEIGHT 0.01   // Whitted-style branches contributing less are not traced, 0.0 traces the full tree, only Fresnel splits lower the weight since mirrors and glass are lossless, so their chains still end at MAX_DEPTH
 #define BACKGROUND_R 0.0
 #define BACKGROUND_G 0.0
 #define BACKGROUND_B 0.0
@@ -141,6 +194,11 @@ inline bool solveQuadratic(const float &a, const float &b, const float &c, float
     return true;
 }
 
+inline float powerHeuristic(float pdf, float otherPdf) {
+    // multiple importance sampling weight of one sample from each of two strategies
+    return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+}
+
 inline Vector3f toWorld(const Vector3f &vecLocal, const Vector3f &normalWorld) {
     Vector3f B, C;
     if (std::fabs(normalWorld.x) > std::fabs(normalWorld.y)) {
@@ -154,22 +212,69 @@ inline Vector3f toWorld(const Vector3f &vecLocal, const Vector3f &normalWorld) {
     return vecLocal.x * B + vecLocal.y * C + vecLocal.z * normalWorld;
 }
 
+/*
+Counter-based random numbers
+every value is a pure function of (pixel, sample, dimension) drawn from the Sampler, so images are 
+bit-identical regardless of thread count or tiling, and threads never share state
+every decision reads a fixed dimension of its bounce, so low-discrepancy samplers stratify it across the samples of a pixel
+*/
+constexpr uint32_t CAMERA_DIMENSIONS = 2;       // position inside the pixel
+enum BounceDimension : uint32_t {
+    DIMENSION_LIGHT = 0,        // point or area light, which light, then up to 4 for the point on it
+    DIMENSION_RR = 6,
+    DIMENSION_FRESNEL = 7,      // reflection or refraction
+    DIMENSION_BSDF = 8,         // 2D direction
+    BOUNCE_DIMENSIONS = 10
+};
+
+struct RandomState {
+    uint32_t x = 0, y = 0;      // pixel
+    uint32_t sample = 0;
+    uint32_t dimension = 0;     // advanced by every draw
+};
+
+inline RandomState &getRandomState() {
+    thread_local RandomState state;
+    return state;
+}
+
+inline void seedRandom(uint32_t x, uint32_t y, uint32_t sample) {
+    // restart the per-thread stream at the first dimension of (pixel, sample)
+    RandomState &state = getRandomState();
+    state.x = x;
+    state.y = y;
+    state.sample = sample;
+    state.dimension = 0;
+}
+
+inline void startRandomDimension(uint32_t depth, BounceDimension dimension) {
+    getRandomState().dimension = CAMERA_DIMENSIONS + depth * BOUNCE_DIMENSIONS + dimension;
+}
+
+inline uint32_t pcgHash(uint32_t v) {
+    // PCG-RXS-M-XS output permutation as an integer hash
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
 inline float getRandomFloat() {
     // return random number in [0.0, 1.0)
-    static std::random_device dev;
-    static std::mt19937 rng(dev());
-    static std::uniform_real_distribution<float> dist(0.f, 1.f);
+    RandomState &state = getRandomState();
+    return Sampler::get(state.x, state.y, state.sample, state.dimension++);
+}
 
-    return dist(rng);
+inline void getRandom2D(float &u, float &v) {
+    // 2D samples start at an even dimension, where Sobol pairs its dimensions
+    RandomState &state = getRandomState();
+    state.dimension += state.dimension & 1;
+    u = getRandomFloat();
+    v = getRandomFloat();
 }
 
 inline int getRandomInt(int low, int high) {
     // return random number in [low, high]
-    static std::random_device dev;
-    static std::mt19937 rng(dev());
-    static std::uniform_int_distribution<int> dist(low, high);
-
-    return dist(rng);
+    return low + std::min(int(getRandomFloat() * (high - low + 1)), high - low);
 }
 
 inline void updateProgress(float progress) {
@@ -0,0 +1,89 @@
+#include <fstream>
+
+#include <opencv4/opencv2/opencv.hpp>
+
+#include "imagewriter.hpp"
+#include "raytracer.hpp"
+
+
+ImageWriter::ImageWriter(int threadCount): submitted(0), pending(0), stopping(false), isFailed(false) {
+    for (int i = 0; i < threadCount; ++i)
+        workers.emplace_back(&ImageWriter::work, this);
+}
+
+ImageWriter::~ImageWriter() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsCondition.notify_all();
+    for (auto &worker: workers)
+        worker.join();
+}
+
+void ImageWriter::submit(const std::string &filename, std::vector<Eigen::Vector3f> radiance, int width, int height) {
+    std::unique_lock<std::mutex> lock(jobsMutex);
+    jobsCondition.wait(lock, [this]() { return jobs.size() < OUTPUT_QUEUE_SIZE; });
+    jobs.push_back(Job{filename, submitted++, width, height, std::move(radiance)});
+    ++pending;
+    lock.unlock();
+    jobsCondition.notify_all();
+}
+
+bool ImageWriter::wait() {
+    std::unique_lock<std::mutex> lock(jobsMutex);
+    jobsCondition.wait(lock, [this]() { return pending == 0; });
+    bool isWritten = !isFailed;
+    isFailed = false;
+    return isWritten;
+}
+
+void ImageWriter::work() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(jobsMutex);
+        jobsCondition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+            return;
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+        // a slot is free now, wake up a blocked submit
+        jobsCondition.notify_all();
+
+        bool isWritten = encode(job);
+
+        lock.lock();
+        isFailed |= !isWritten;
+        --pending;
+        lock.unlock();
+        jobsCondition.notify_all();
+    }
+}
+
+bool ImageWriter::encode(const Job &job) {
+    cv::Mat image(job.height, job.width, CV_8UC3);
+    for (int j = 0; j < job.height; ++j) {
+        for (int i = 0; i < job.width; ++i) {
+            // GAMMA correction and RGB to BGR in one go
+            Eigen::Vector3f color = RayTracer::toneMap(job.radiance[j * job.width + i]);
+            image.at<cv::Vec3b>(j, i)[0] = uint8_t(color.z() + 0.5f);
+            image.at<cv::Vec3b>(j, i)[1] = uint8_t(color.y() + 0.5f);
+            image.at<cv::Vec3b>(j, i)[2] = uint8_t(color.x() + 0.5f);
+        }
+    }
+    size_t extension = job.filename.rfind('.');
+    std::vector<uint8_t> encoded;
+    if (extension == std::string::npos || !cv::imencode(job.filename.substr(extension), image, encoded))
+        return false;
+
+    // the file write is serialized, a newer image of the same file may have been written already
+    std::lock_guard<std::mutex> lock(filesMutex);
+    auto last = latest.find(job.filename);
+    if (last != latest.end() && last->second > job.sequence)
+        return true;
+    latest[job.filename] = job.sequence;
+    std::ofstream file(job.filename, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+    return bool(file);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <eigen3/Eigen/Eigen>
+
+#include "vector.hpp"
+#include "global.hpp"
+
+
+/*
+Image Writer implementation
+CORE:
+- asynchronous output stage (GAMMA correction, colour conversion and encoding on background threads)
+- bounded queue with back-pressure
+
+NOTE:
+- submit blocks while OUTPUT_QUEUE_SIZE images are waiting, so memory stays bounded
+- images are encoded in parallel but a file is never overwritten by an older submission
+*/
+class ImageWriter {
+private:
+    struct Job {
+        std::string filename;
+        uint64_t sequence;                          // submission order
+        int width, height;
+        std::vector<Eigen::Vector3f> radiance;      // linear radiance, row-major
+    };
+
+    std::deque<Job> jobs;
+    uint64_t submitted;
+    int pending;                                    // jobs queued or being encoded
+    bool stopping;
+    bool isFailed;
+    std::mutex jobsMutex;
+    std::condition_variable jobsCondition;          // signalled when a job is queued or finished
+    std::vector<std::thread> workers;
+    std::mutex filesMutex;
+    std::map<std::string, uint64_t> latest;         // sequence of the image last written to each file
+
+public:
+    ImageWriter(int threadCount = OUTPUT_THREADS);
+    ~ImageWriter();
+
+    void submit(const std::string &filename, std::vector<Eigen::Vector3f> radiance, int width, int height);
+    // block until every submitted image is on disk, return whether all of them were written
+    bool wait();
+
+private:
+    void work();
+    bool encode(const Job &job);
+};
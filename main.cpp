@@ -1,4 +1,7 @@
 #include <chrono>
+#include <cstdio>
+#include <limits>
+#include <string>
 
 #include <eigen3/Eigen/Eigen>
 #include <opencv4/opencv2/opencv.hpp>
@@ -8,73 +11,274 @@
 #include "scene.hpp"
 #include "camera.hpp"
 #include "raytracer.hpp"
-#include "material.hpp"
-#include "sphere.hpp"
-#include "cylinder.hpp"
-#include "cone.hpp"
-#include "triangle.hpp"
-#include "light.hpp"
+#include "imagewriter.hpp"
+#include "server.hpp"
+#include "config.hpp"
 
 
-int main(int argc, char **argv) {
-    // initialize scene
-    Scene scene;
+void saveRegions(const std::string &filename, std::vector<Eigen::Vector3f> &frameBuffer, int width, int height,
+                 const std::vector<RayTracer::Region> &regions, const std::string &compositeFilename) {
+    cv::Mat image(height, width, CV_32FC3, frameBuffer.data());
+    image.convertTo(image, CV_8UC3, 1.0f);
+    cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
 
-    // add primitives
-    Material *whiteMat = new Material(MaterialType::DIFFUSE, Vector3f(WHITE_KA_R, WHITE_KA_G, WHITE_KA_B), 
-                                      Vector3f(WHITE_KD_R, WHITE_KD_G, WHITE_KD_B), Vector3f(WHITE_KS_R, WHITE_KS_G, WHITE_KS_B), RED_SE);
-    Material *redMat = new Material(MaterialType::DIFFUSE, Vector3f(RED_KA_R, RED_KA_G, RED_KA_B), 
-                                    Vector3f(RED_KD_R, RED_KD_G, RED_KD_B), Vector3f(RED_KS_R, RED_KS_G, RED_KS_B), RED_SE);
-    Material *greenMat = new Material(MaterialType::DIFFUSE, Vector3f(GREEN_KA_R, GREEN_KA_G, GREEN_KA_B), 
-                                      Vector3f(GREEN_KD_R, GREEN_KD_G, GREEN_KD_B), Vector3f(GREEN_KS_R, GREEN_KS_G, GREEN_KS_B), GREEN_SE);
-    Material *reflectMat = new Material(MaterialType::REFLECTION);
-    Material *refractMat = new Material(MaterialType::REFRACTION, REFRACTION_IOR);
-    Material *reflectRefractMat = new Material(MaterialType::REFLECTION_AND_REFRACTION, REFLECTION_REFRACTION_IOR);
-    Material *lightMat1 = new Material(MaterialType::EMISSION, Vector3f(LIGHT_INTENSITY_R1, LIGHT_INTENSITY_G1, LIGHT_INTENSITY_B1));
+    // rectangles outside of the image stay empty
+    std::vector<cv::Rect> rects;
+    for (const RayTracer::Region &region: regions) {
+        int x1 = std::min<int>(region.x1, width), y1 = std::min<int>(region.y1, height);
+        rects.emplace_back(region.x0, region.y0, std::max(0, x1 - int(region.x0)), std::max(0, y1 - int(region.y0)));
+    }
+    if (!compositeFilename.empty()) {
+        // paste the regions over the previous full frame
+        cv::Mat previous = cv::imread(compositeFilename, cv::IMREAD_COLOR);
+        if (!previous.empty() && previous.rows == height && previous.cols == width) {
+            for (const cv::Rect &rect: rects)
+                if (!rect.empty())
+                    image(rect).copyTo(previous(rect));
+            cv::imwrite(filename, previous);
+            return;
+        }
+        std::cerr << "Cannot composite over " << compositeFilename << ", write the crops instead" << std::endl;
+    }
+    // one crop per rectangle, several of them are numbered in the order given, e.g. output_0.png and output_1.png,
+    // so no unrendered pixels between them are written
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos || dot < filename.find_last_of('/') + 1)
+        dot = filename.size();
+    for (size_t k = 0; k < rects.size(); ++k) {
+        if (rects[k].empty())
+            continue;
+        std::string cropFilename = (rects.size() == 1) ? filename : filename.substr(0, dot) + "_" + std::to_string(k) + filename.substr(dot);
+        cv::imwrite(cropFilename, image(rects[k]));
+    }
+}
 
-    MeshTriangle floor(CORNELLBOX_FLOOR_OBJ, whiteMat, "floor");
-    MeshTriangle left(CORNELLBOX_LEFTWALL_OBJ, redMat, "left");
-    MeshTriangle right(CORNELLBOX_RIGHTWALL_OBJ, greenMat, "right");
-    MeshTriangle shortbox(CORNELLBOX_SHORTBOX_OBJ, reflectRefractMat, "shortbox");
-    MeshTriangle tallbox(CORNELLBOX_TALLBOX_OBJ, reflectMat, "tallbox");
-    Sphere sphere(Vector3f(SPHERE_POS_X, SPHERE_POS_Y, SPHERE_POS_Z), SPHERE_RADIUS, refractMat, "sphere");
-    Cylinder cylinder(Vector3f(CYLINDER_POS_X, CYLINDER_POS_Y, CYLINDER_POS_Z), 
-                      Vector3f(CYLINDER_DIR_X, CYLINDER_DIR_Y, CYLINDER_DIR_Z), 
-                      CYLINDER_RADIUS, CYLINDER_HEIGHT, whiteMat, "cylinder");
-    Cone cone(Vector3f(CONE_POS_X, CONE_POS_Y, CONE_POS_Z), 
-              Vector3f(CYLINDER_DIR_X, CYLINDER_DIR_Y, CYLINDER_DIR_Z), 
-              CONE_RADIUS, CONE_HEIGHT, whiteMat, "cone");
-    MeshTriangle light1(CORNELLBOX_LIGHT_OBJ, lightMat1, "light1");
-    Light light2(Vector3f(LIGHT_POX_X2, LIGHT_POX_Y2, LIGHT_POX_Z2), Vector3f(LIGHT_INTENSITY_R2, LIGHT_INTENSITY_G2, LIGHT_INTENSITY_B2));
+bool parseRange(const char *text, uint32_t &begin, uint32_t &end) {
+    // parse "<begin>:<end>"
+    return std::sscanf(text, "%u:%u", &begin, &end) == 2 && begin <= end;
+}
 
-    scene.add(&floor);
-    scene.add(&left);
-    scene.add(&right);
-    scene.add(&shortbox);
-    scene.add(&tallbox);
-    scene.add(&sphere);
-    scene.add(&cylinder);
-    scene.add(&cone);
-    scene.add(&light1);
-    scene.add(&light2);
+bool parseRegion(const char *text, RayTracer::Region &region) {
+    // parse "<x0>:<y0>:<x1>:<y1>"
+    return std::sscanf(text, "%u:%u:%u:%u", &region.x0, &region.y0, &region.x1, &region.y1) == 4 &&
+           region.x0 < region.x1 && region.y0 < region.y1;
+}
+
+int main(int argc, char **argv) {
+    // runtime configuration
+    // --scene <file>                   read settings, camera and scene from the file instead of the built-in Cornell box
+    // --set "<statement>"              apply one statement of the scene file syntax, e.g. --set "spp 64"
+    // distributed rendering
+    // --merge <output> <partial>...    merge partial results into the final image
+    // --tiles <begin>:<end>            only render DISTRIBUTED_TILE_SIZE tiles in [begin, end)
+    // --samples <begin>:<end>          only render sample indices in [begin, end)
+    // --partial <file>                 write the float partial result instead of the image
+    // region of interest rendering
+    // --crop <x0>:<y0>:<x1>:<y1>       only render the pixel rectangle, can be given several times
+    // --composite <image>              paste the rectangles over a previous full frame instead of writing the crops
+    // animation
+    // --sequence <keyframes>           render every frame of the camera path to SEQUENCE_FILENAME
+    // NUMA placement
+    // --numa <policy>                  none, first-touch, interleaved or replicated
+    // --numa-benchmark                 render once with every placement and compare the timings
+    // sampling
+    // --sampler <type>                 random, sobol, halton or bluenoise
+    // arbitrary output variables
+    // --aovs <list>                    depth, normal, albedo, objectid, split, lightgroups or all, written to AOV_FILENAME
+    // render server
+    // --server <socket>                keep the scene resident and render jobs sent to the Unix domain socket
+    // --submit <socket> <job> <output> send a job to a running server and write its result
+    std::string partialFilename, compositeFilename, sequenceFilename, socketFilename;
+    std::vector<RayTracer::Region> regions;
+    RayTracer::Region region;
+    uint32_t tileBegin = 0, tileEnd = std::numeric_limits<uint32_t>::max();
+    uint32_t sampleBegin = 0, sampleEnd = 0;
+    bool isSampleRange = false;
+    NumaPlacement::Policy numaPolicy = NumaPlacement::Policy::NONE;
+    NumaPlacement::parsePolicy(NUMA_POLICY, numaPolicy);
+    bool isNumaBenchmark = false;
+    uint32_t aovFlags = 0;
+    AOVBuffer::parse(AOV_LIST, aovFlags);
+    Config config;
+    std::string error;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--scene" && i + 1 < argc) {
+            if (!config.load(argv[++i], error)) {
+                std::cerr << "Cannot load scene: " << error << std::endl;
+                return 1;
+            }
+        } else if (arg == "--set" && i + 1 < argc) {
+            if (!config.parse(argv[++i], error)) {
+                std::cerr << "Cannot apply setting: " << error << std::endl;
+                return 1;
+            }
+        } else if (arg == "--merge" && i + 2 < argc) {
+            RayTracer merged;
+            for (int k = i + 2; k < argc; ++k) {
+                if (!merged.mergePartial(argv[k])) {
+                    std::cerr << "Cannot merge partial result: " << argv[k] << std::endl;
+                    return 1;
+                }
+            }
+            ImageWriter writer(1);
+            writer.submit(argv[i + 1], merged.resolve(), merged.getWidth(), merged.getHeight());
+            if (!writer.wait()) {
+                std::cerr << "Cannot write merged image: " << argv[i + 1] << std::endl;
+                return 1;
+            }
+            std::cout << "Merged " << argc - i - 2 << " partial results into " << argv[i + 1] << std::endl;
+            return 0;
+        } else if (arg == "--submit" && i + 3 < argc) {
+            return RenderServer::submit(argv[i + 1], argv[i + 2], argv[i + 3]) ? 0 : 1;
+        } else if (arg == "--server" && i + 1 < argc) {
+            socketFilename = argv[++i];
+        } else if (arg == "--tiles" && i + 1 < argc && parseRange(argv[i + 1], tileBegin, tileEnd)) {
+            ++i;
+        } else if (arg == "--samples" && i + 1 < argc && parseRange(argv[i + 1], sampleBegin, sampleEnd)) {
+            isSampleRange = true;
+            ++i;
+        } else if (arg == "--partial" && i + 1 < argc) {
+            partialFilename = argv[++i];
+        } else if (arg == "--crop" && i + 1 < argc && parseRegion(argv[i + 1], region)) {
+            regions.push_back(region);
+            ++i;
+        } else if (arg == "--composite" && i + 1 < argc) {
+            compositeFilename = argv[++i];
+        } else if (arg == "--sequence" && i + 1 < argc) {
+            sequenceFilename = argv[++i];
+        } else if (arg == "--numa" && i + 1 < argc && NumaPlacement::parsePolicy(argv[i + 1], numaPolicy)) {
+            ++i;
+        } else if (arg == "--sampler" && i + 1 < argc && Sampler::parseType(argv[i + 1], config.sampler)) {
+            ++i;
+        } else if (arg == "--aovs" && i + 1 < argc && AOVBuffer::parse(argv[i + 1], aovFlags)) {
+            ++i;
+        } else if (arg == "--numa-benchmark") {
+            isNumaBenchmark = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    Sampler::setType(config.sampler);
+    if (!isSampleRange)
+        sampleEnd = config.getSamples();
+
+    // initialize scene, the built-in Cornell box unless a scene file was given
+    Scene scene;
+    if (!config.buildScene(scene, error)) {
+        std::cerr << "Cannot build scene: " << error << std::endl;
+        return 1;
+    }
 
-    // accelerate
-    if (IS_BVH)
-        scene.buildBVH();
-    
     // set camera
-    Camera camera(WIDTH, HEIGHT, FOV, Vector3f(EYE_POS_X, EYE_POS_Y, EYE_POS_Z), 
-                    Vector3f(EYE_FRONT_X, EYE_FRONT_Y, EYE_FRONT_Z), 
-                    Vector3f(EYE_UP_X, EYE_UP_Y, EYE_UP_Z));
+    Camera camera = config.getCamera();
+    const std::string &filename = config.filename;
+
+    if (!socketFilename.empty()) {
+        RenderServer server(scene, config, socketFilename);
+        if (!server.run()) {
+            std::cerr << "Cannot listen on " << socketFilename << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
     // ray tracing
     RayTracer r;
+    config.configure(r);
+    if (isNumaBenchmark) {
+        using Clock = std::chrono::steady_clock;
+        for (NumaPlacement::Policy policy: {NumaPlacement::Policy::NONE, NumaPlacement::Policy::INTERLEAVED,
+                                            NumaPlacement::Policy::FIRST_TOUCH, NumaPlacement::Policy::REPLICATED}) {
+            auto begin = Clock::now();
+            NumaPlacement benchmarkPlacement(scene, policy);
+            auto placed = Clock::now();
+            r.setPlacement(&benchmarkPlacement);
+            r.render(scene, camera);
+            auto rendered = Clock::now();
+            r.setPlacement(nullptr);
+            std::cout << "NUMA " << NumaPlacement::getPolicyName(policy) << " on " << benchmarkPlacement.getNodeCount() << " nodes: "
+                      << std::chrono::duration<double>(placed - begin).count() << " seconds placement, "
+                      << std::chrono::duration<double>(rendered - placed).count() << " seconds rendering" << std::endl;
+        }
+        return 0;
+    }
+    NumaPlacement placement(scene, numaPolicy);
+    r.setPlacement(&placement);
+    r.setAOVs(aovFlags, scene);
+    // images are encoded in the background, the next pass renders meanwhile
+    ImageWriter writer;
     auto start = std::chrono::system_clock::now();
-    r.render(scene, camera);
-    cv::Mat image(HEIGHT, WIDTH, CV_32FC3, r.capture().data());
-    image.convertTo(image, CV_8UC3, 1.0f);
-    cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
-    cv::imwrite(FILENAME, image);
+    if (!partialFilename.empty()) {
+        r.renderPartial(scene, camera, tileBegin, tileEnd, sampleBegin, sampleEnd);
+        if (!r.saveCheckpoint(partialFilename)) {
+            std::cerr << "Cannot write partial result: " << partialFilename << std::endl;
+            return 1;
+        }
+        std::cout << "Partial result written: " << partialFilename << std::endl;
+        return 0;
+    } else if (!sequenceFilename.empty()) {
+        // scene and accelerators stay resident, only the camera moves
+        CameraPath path;
+        if (!path.load(sequenceFilename)) {
+            std::cerr << "Cannot read camera path: " << sequenceFilename << std::endl;
+            return 1;
+        }
+        path.width = camera.width;
+        path.height = camera.height;
+        path.fov = camera.fov;
+        r.renderSequence(scene, path, writer, SEQUENCE_FILENAME);
+        if (!writer.wait()) {
+            std::cerr << "Cannot write sequence frames" << std::endl;
+            return 1;
+        }
+        std::cout << "Sequence written: " << path.getFrameCount() << " frames" << std::endl;
+    } else if (IS_STREAMING) {
+        // tiles go to disk as they finish, there is no full frame to write at the end
+        TileWriter tileWriter(camera.width, camera.height, STREAMING_FLOAT_FILENAME, STREAMING_FILENAME);
+        if (!tileWriter.isOpen() || !r.renderStreaming(scene, camera, tileWriter)) {
+            std::cerr << "Cannot write streaming output" << std::endl;
+            return 1;
+        }
+    } else if (!regions.empty()) {
+        r.renderRegions(scene, camera, regions, config.getSamples());
+    } else if (IS_TIMED) {
+        RayTracer::RenderStats stats = r.renderTimed(scene, camera, std::chrono::steady_clock::now() + std::chrono::seconds(TIME_BUDGET_SECONDS));
+        std::cout << "Time budget: " << stats.passes << " passes in " << stats.seconds << " seconds, "
+                  << stats.minSamples << "-" << stats.maxSamples << " spp (" << stats.meanSamples << " on average)" << std::endl;
+    } else if (IS_ADAPTIVE) {
+        r.renderAdaptive(scene, camera);
+        std::cout << "Adaptive sampling: " << r.getTotalSamples() / (double(camera.width) * camera.height) << " spp on average" << std::endl;
+    } else if (!IS_PROGRESSIVE) {
+        r.render(scene, camera);
+    } else {
+        // progressive rendering, resume from the checkpoint if there is a matching one
+        if (r.loadCheckpoint(CHECKPOINT_FILENAME, camera))
+            std::cout << "Resume from checkpoint: " << r.getSamples() << " spp" << std::endl;
+        int pass = 0;
+        while (r.getSamples() < PROGRESSIVE_TARGET_SAMPLES) {
+            r.renderPass(scene, camera, std::min<uint32_t>(PROGRESSIVE_PASS_SAMPLES, PROGRESSIVE_TARGET_SAMPLES - r.getSamples()));
+            ++pass;
+            std::cout << "Pass " << pass << ": " << r.getSamples() << " spp" << std::endl;
+            if (pass % PROGRESSIVE_CHECKPOINT_INTERVAL == 0)
+                r.saveCheckpoint(CHECKPOINT_FILENAME);
+            if (pass % PROGRESSIVE_WRITE_INTERVAL == 0)
+                writer.submit(filename, r.resolve(), camera.width, camera.height);
+        }
+        r.saveCheckpoint(CHECKPOINT_FILENAME);
+    }
+    if (!IS_STREAMING && sequenceFilename.empty()) {
+        if (regions.empty())
+            writer.submit(filename, r.resolve(), camera.width, camera.height);
+        else
+            saveRegions(filename, r.capture(), camera.width, camera.height, regions, compositeFilename);
+    }
+    if (!writer.wait())
+        std::cerr << "Cannot write image: " << filename << std::endl;
+    if (aovFlags != 0 && !IS_STREAMING && sequenceFilename.empty() && !r.saveAOVs(AOV_FILENAME))
+        std::cerr << "Cannot write AOVs: " << AOV_FILENAME << std::endl;
     auto stop = std::chrono::system_clock::now();
 
     std::cout << "Render complete: " << std::endl;
@@ -6,10 +6,21 @@
 
 enum MaterialType { DIFFUSE, REFLECTION, REFRACTION, REFLECTION_AND_REFRACTION, EMISSION };
 
+// direction drawn from the lobe of a material together with its BRDF and pdf
+struct BSDFSample {
+    Vector3f direction;
+    Vector3f f;
+    float pdf = 0.0f;
+};
+
 /*
 Material implementation
 CORE: 
 - BRDF
+- importance sampling of the BRDF lobe (cosine-weighted for diffuse)
+
+NOTE:
+- a new lobe adds its case to sample, pdf and brdf, the integrators only see BSDFSample
 */
 class Material {
 public:
@@ -36,7 +47,8 @@ public:
 
     inline MaterialType getType() const;
 
-    inline Vector3f sample(const Vector3f &wi, const Vector3f &N);
+    // false if the material has no lobe to continue the path with
+    inline bool sample(const Vector3f &wi, const Vector3f &N, BSDFSample &result);
     inline float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
     inline Vector3f brdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
 };
@@ -45,21 +57,42 @@ inline MaterialType Material::getType() const {
     return materialType;
 }
 
-inline Vector3f Material::sample(const Vector3f &wi, const Vector3f &N) {
-    // uniform sample on the hemisphere, return a sampled ray
-    float x_1 = getRandomFloat(), x_2 = getRandomFloat();
-    float z = std::fabs(1.0f - 2.0f * x_1);
-    float r = std::sqrt(1.0f - z * z), phi = 2 * MY_PI * x_2;
-    Vector3f localRay(r * std::cos(phi), r * std::sin(phi), z);
-    return toWorld(localRay, N);
+inline bool Material::sample(const Vector3f &wi, const Vector3f &N, BSDFSample &result) {
+    switch (materialType) {
+        case DIFFUSE:
+        {
+            // cosine-weighted sample on the hemisphere, a uniform point on the disk lifted onto it
+            float x_1, x_2;
+            getRandom2D(x_1, x_2);
+            float r = std::sqrt(x_1), phi = 2 * MY_PI * x_2;
+            Vector3f localRay(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - x_1)));
+            result.direction = toWorld(localRay, N).normalized();
+        } break;
+        default:
+        {
+            // ideal reflection and refraction are directly programmed in castRay
+            return false;
+        }
+    }
+    result.pdf = pdf(wi, result.direction, N);
+    result.f = brdf(wi, result.direction, N);
+    return result.pdf > 0.0f;
 }
 
 inline float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) {
-    // uniform sample probability 1 / (2 * PI)
-    if (dotProduct(wo, N) > 0.0f)
-        return 0.5f / MY_PI;
-    else
-        return 0.0f;
+    switch (materialType) {
+        case DIFFUSE:
+        {
+            // cosine-weighted sample probability cos / PI
+            float cosalpha = dotProduct(wo, N);
+            return (cosalpha > 0.0f) ? cosalpha / MY_PI : 0.0f;
+        } break;
+        default:
+        {
+            // delta lobes are never sampled by Material
+            return 0.0f;
+        }
+    }
 }
 
 inline Vector3f Material::brdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) {
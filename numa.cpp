@@ -0,0 +1,140 @@
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "numa.hpp"
+
+
+static std::vector<int> parseList(const std::string &text) {
+    // sysfs list format, e.g. "0-3,8-11"
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        int first, last;
+        char dash;
+        std::stringstream rangeStream(range);
+        if (!(rangeStream >> first))
+            continue;
+        if (!(rangeStream >> dash >> last))
+            last = first;
+        for (int value = first; value <= last; ++value)
+            values.push_back(value);
+    }
+    return values;
+}
+
+static std::string readLine(const std::string &filename) {
+    std::ifstream file(filename);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+static bool setMemoryPolicy(int mode, const std::vector<int> &nodes) {
+    std::vector<unsigned long> mask;
+    for (int node: nodes) {
+        if (node / 64 >= int(mask.size()))
+            mask.resize(node / 64 + 1, 0);
+        mask[node / 64] |= 1ul << (node % 64);
+    }
+    // the kernel reads maxnode - 1 bits
+    return syscall(SYS_set_mempolicy, mode, mask.empty() ? nullptr : mask.data(), mask.size() * 64 + 1) == 0;
+}
+
+NumaPlacement::NumaPlacement(const Scene &_scene, Policy _policy): scene(_scene), policy(_policy) {
+    for (int node: parseList(readLine("/sys/devices/system/node/online"))) {
+        std::vector<int> cpus = parseList(readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        if (!cpus.empty()) {
+            nodes.push_back(node);
+            nodeCpus.push_back(cpus);
+        }
+    }
+    if (nodes.empty()) {
+        // no sysfs topology, treat the machine as one node with every cpu
+        nodes.push_back(0);
+        nodeCpus.emplace_back();
+        for (int cpu = 0; cpu < int(std::thread::hardware_concurrency()); ++cpu)
+            nodeCpus[0].push_back(cpu);
+    }
+
+    // the copies are built by a thread under the memory policy, so their pages land where they will be read
+    if (policy == Policy::INTERLEAVED) {
+        replicas.resize(1);
+        std::thread builder([this]() {
+            if (!setMemoryPolicy(MPOL_INTERLEAVE, nodes))
+                std::cerr << "Cannot interleave memory, the scene copy is first-touch" << std::endl;
+            replicas[0] = scene.replicate();
+            setMemoryPolicy(MPOL_DEFAULT, {});
+        });
+        builder.join();
+    } else if (policy == Policy::REPLICATED) {
+        replicas.resize(nodes.size());
+        std::vector<std::thread> builders;
+        for (int n = 0; n < int(nodes.size()); ++n) {
+            builders.emplace_back([this, n]() {
+                pin(n);
+                setMemoryPolicy(MPOL_PREFERRED, {nodes[n]});
+                replicas[n] = scene.replicate();
+                setMemoryPolicy(MPOL_DEFAULT, {});
+            });
+        }
+        for (auto &builder: builders)
+            builder.join();
+    }
+}
+
+NumaPlacement::Binding::Binding(const NumaPlacement *placement, int worker, const Scene &sharedScene)
+    : scene(&sharedScene), isPinned(false) {
+    if (placement == nullptr || placement->policy == Policy::NONE)
+        return;
+    isPinned = pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) == 0;
+    // workers are dealt round robin, so any thread count spreads evenly over the nodes
+    int n = worker % placement->nodes.size();
+    if (isPinned)
+        placement->pin(n);
+    if (placement->policy == Policy::REPLICATED)
+        scene = placement->replicas[n].get();
+    else if (placement->policy == Policy::INTERLEAVED)
+        scene = placement->replicas[0].get();
+    else
+        scene = &placement->scene;
+}
+
+NumaPlacement::Binding::~Binding() {
+    if (isPinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+}
+
+void NumaPlacement::pin(int node) const {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu: nodeCpus[node])
+        CPU_SET(cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+bool NumaPlacement::parsePolicy(const std::string &text, Policy &policy) {
+    for (Policy candidate: {Policy::NONE, Policy::FIRST_TOUCH, Policy::INTERLEAVED, Policy::REPLICATED}) {
+        if (text == getPolicyName(candidate)) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *NumaPlacement::getPolicyName(Policy policy) {
+    switch (policy) {
+        case Policy::FIRST_TOUCH: return "first-touch";
+        case Policy::INTERLEAVED: return "interleaved";
+        case Policy::REPLICATED: return "replicated";
+        default: return "none";
+    }
+}
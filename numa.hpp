@@ -0,0 +1,68 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+
+#include "vector.hpp"
+#include "global.hpp"
+#include "scene.hpp"
+
+
+/*
+NUMA Placement implementation
+CORE:
+- worker pinning to the cpus of a NUMA node
+- scene placement (first-touch, interleaved or replicated per node)
+
+NOTE:
+- topology comes from sysfs, pinning from pthread_setaffinity_np and memory policy from set_mempolicy,
+  so no extra library is needed and a machine without NUMA is a single node
+- first-touch keeps the scene where the main thread built it, interleaved copies it once with pages spread
+  over all nodes, replicated copies it once per node so every worker traverses local memory
+*/
+class NumaPlacement {
+public:
+    enum class Policy { NONE, FIRST_TOUCH, INTERLEAVED, REPLICATED };
+
+private:
+    const Scene &scene;
+    Policy policy;
+    std::vector<int> nodes;                         // nodes with cpus
+    std::vector<std::vector<int>> nodeCpus;
+    std::vector<std::unique_ptr<Scene>> replicas;   // one per node if replicated, a single one if interleaved
+
+public:
+    // pins the calling thread to the node of the worker while it lives and restores the affinity it had before,
+    // so a tile rendered on the main thread leaves neither it nor the threads it starts later pinned
+    class Binding {
+    private:
+        const Scene *scene;
+        bool isPinned;
+        cpu_set_t previous;
+
+    public:
+        // without a placement the thread stays as it is and traverses the shared scene
+        Binding(const NumaPlacement *placement, int worker, const Scene &sharedScene);
+        Binding(const Binding &) = delete;
+        Binding &operator=(const Binding &) = delete;
+        ~Binding();
+
+        // the scene the worker should traverse
+        const Scene &getScene() const { return *scene; }
+    };
+
+public:
+    NumaPlacement(const Scene &_scene, Policy _policy);
+
+    Policy getPolicy() const { return policy; }
+    int getNodeCount() const { return nodes.size(); }
+
+    static bool parsePolicy(const std::string &text, Policy &policy);
+    static const char *getPolicyName(Policy policy);
+
+private:
+    void pin(int node) const;
+};
@@ -13,11 +13,15 @@ class Object {
 public:
     Material *material = nullptr;
     std::string name;
+    uint32_t id = 0;            // index in the scene, shared by the triangles of a mesh, only needed by AOVs
 
     Object() {}
     Object(Material *m, std::string n): material(m), name(n) {}
     virtual ~Object() {}
 
+    virtual Object *clone() const = 0;      // deep copy sharing the material, only needed by scene replication
+    virtual void setId(uint32_t _id) { id = _id; }
+
     virtual AABB getBoundingBox() = 0;
     virtual float getArea() = 0;
     virtual Intersection getIntersection(Ray ray) = 0;
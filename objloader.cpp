@@ -0,0 +1,228 @@
+#include <charconv>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "objloader.hpp"
+
+
+struct OBJChunk {
+    const char *begin, *end;
+    std::vector<Vector3f> positions;
+    // absolute indices are 0-based, relative ones count from the vertices of this chunk until merged
+    std::vector<int64_t> indices;
+    std::vector<size_t> relative;               // where indices holds a relative index
+    std::vector<OBJLoader::Object> objects;     // firstTriangle counts from the chunk
+    std::vector<std::pair<int64_t, bool>> polygon;  // reused by every face
+    size_t lineCount = 0;
+    std::string error;                          // empty while the chunk is valid
+};
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skipSpaces(const char *p, const char *end) {
+    while (p < end && isSpace(*p))
+        ++p;
+    return p;
+}
+
+static bool parseFloat(const char *&p, const char *end, float &value) {
+    p = skipSpaces(p, end);
+    // from_chars does not accept an explicit plus sign
+    if (p < end && *p == '+')
+        ++p;
+    std::from_chars_result result = std::from_chars(p, end, value);
+    p = result.ptr;
+    return result.ec == std::errc() && (p == end || isSpace(*p));
+}
+
+static bool parseFace(OBJChunk &chunk, const char *p, const char *end) {
+    chunk.polygon.clear();
+    while ((p = skipSpaces(p, end)) < end) {
+        int64_t index;
+        std::from_chars_result result = std::from_chars(p, end, index);
+        if (result.ec != std::errc() || index == 0 || (result.ptr < end && !isSpace(*result.ptr) && *result.ptr != '/'))
+            return false;
+        if (index > 0)
+            chunk.polygon.emplace_back(index - 1, false);
+        else
+            chunk.polygon.emplace_back(int64_t(chunk.positions.size()) + index, true);
+        // texture coordinate and normal indices are not needed
+        for (p = result.ptr; p < end && !isSpace(*p); ++p);
+    }
+    if (chunk.polygon.size() < 3)
+        return false;
+
+    for (size_t i = 1; i + 1 < chunk.polygon.size(); ++i) {
+        for (size_t corner: {size_t(0), i, i + 1}) {
+            if (chunk.polygon[corner].second)
+                chunk.relative.push_back(chunk.indices.size());
+            chunk.indices.push_back(chunk.polygon[corner].first);
+        }
+    }
+    return true;
+}
+
+static bool parseLine(OBJChunk &chunk, const char *p, const char *end) {
+    p = skipSpaces(p, end);
+    const char *keyEnd = p;
+    while (keyEnd < end && !isSpace(*keyEnd))
+        ++keyEnd;
+    if (keyEnd - p != 1)
+        return true;                            // comments, vt, vn, usemtl, mtllib and the like
+
+    switch (*p) {
+        case 'v':
+        {
+            // an optional w is ignored
+            Vector3f position;
+            p = keyEnd;
+            if (!parseFloat(p, end, position.x) || !parseFloat(p, end, position.y) || !parseFloat(p, end, position.z))
+                return false;
+            chunk.positions.push_back(position);
+        } break;
+        case 'f':
+            return parseFace(chunk, keyEnd, end);
+        case 'o':
+        case 'g':
+        {
+            const char *nameBegin = skipSpaces(keyEnd, end), *nameEnd = end;
+            while (nameEnd > nameBegin && isSpace(nameEnd[-1]))
+                --nameEnd;
+            chunk.objects.push_back({std::string(nameBegin, nameEnd), uint32_t(chunk.indices.size() / 3), 0});
+        } break;
+        default:
+            break;
+    }
+    return true;
+}
+
+static void parseChunk(OBJChunk &chunk) {
+    for (const char *p = chunk.begin; p < chunk.end;) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', chunk.end - p));
+        if (lineEnd == nullptr)
+            lineEnd = chunk.end;
+        ++chunk.lineCount;
+        if (!parseLine(chunk, p, lineEnd)) {
+            chunk.error = "invalid statement";
+            return;
+        }
+        p = (lineEnd < chunk.end) ? lineEnd + 1 : chunk.end;
+    }
+}
+
+template <typename Function>
+static void parallelFor(size_t count, Function function) {
+    // the calling thread takes the first item
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < count; ++i)
+        threads.emplace_back(function, i);
+    if (count > 0)
+        function(0);
+    for (auto &thread: threads)
+        thread.join();
+}
+
+
+bool OBJLoader::load(const std::string &filename, std::string &error) {
+    positions.clear();
+    indices.clear();
+    objects.clear();
+
+    int file = open(filename.c_str(), O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0) {
+        if (file >= 0)
+            close(file);
+        error = "cannot read " + filename;
+        return false;
+    }
+    size_t size = status.st_size;
+    void *mapping = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0) : nullptr;
+    close(file);
+    if (mapping == MAP_FAILED) {
+        error = "cannot map " + filename;
+        return false;
+    }
+    const char *data = static_cast<const char *>(mapping);
+
+    // chunks start after a line end, so every line belongs to exactly one of them
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / OBJ_CHUNK_SIZE));
+    std::vector<OBJChunk> chunks(chunkCount);
+    const char *previousEnd = data;
+    for (size_t k = 0; k < chunkCount; ++k) {
+        const char *end = data + size * (k + 1) / chunkCount;
+        if (k + 1 < chunkCount) {
+            end = std::max(end, previousEnd);
+            const char *lineEnd = static_cast<const char *>(std::memchr(end, '\n', data + size - end));
+            end = (lineEnd == nullptr) ? data + size : lineEnd + 1;
+        }
+        chunks[k].begin = previousEnd;
+        chunks[k].end = end;
+        previousEnd = end;
+    }
+    parallelFor(chunkCount, [&chunks](size_t k) { parseChunk(chunks[k]); });
+
+    // offsets of every chunk inside the merged buffers
+    std::vector<size_t> vertexOffsets(chunkCount), indexOffsets(chunkCount);
+    size_t vertexCount = 0, indexCount = 0, lineCount = 0;
+    for (size_t k = 0; k < chunkCount; ++k) {
+        if (!chunks[k].error.empty()) {
+            error = filename + ":" + std::to_string(lineCount + chunks[k].lineCount) + ": " + chunks[k].error;
+            if (mapping != nullptr)
+                munmap(mapping, size);
+            return false;
+        }
+        vertexOffsets[k] = vertexCount;
+        indexOffsets[k] = indexCount;
+        vertexCount += chunks[k].positions.size();
+        indexCount += chunks[k].indices.size();
+        lineCount += chunks[k].lineCount;
+    }
+    if (mapping != nullptr)
+        munmap(mapping, size);
+
+    positions.resize(vertexCount);
+    indices.resize(indexCount);
+    parallelFor(chunkCount, [&](size_t k) {
+        OBJChunk &chunk = chunks[k];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + vertexOffsets[k]);
+        for (size_t i: chunk.relative)
+            chunk.indices[i] += vertexOffsets[k];
+        for (size_t i = 0; i < chunk.indices.size(); ++i) {
+            if (chunk.indices[i] < 0 || chunk.indices[i] >= int64_t(vertexCount)) {
+                chunk.error = "vertex index out of range";
+                return;
+            }
+            indices[indexOffsets[k] + i] = uint32_t(chunk.indices[i]);
+        }
+    });
+    for (const OBJChunk &chunk: chunks) {
+        if (!chunk.error.empty()) {
+            error = filename + ": " + chunk.error;
+            positions.clear();
+            indices.clear();
+            return false;
+        }
+    }
+
+    // faces before the first 'o' or 'g' of a chunk continue the object of the chunk before
+    objects.push_back({"", 0, 0});
+    for (size_t k = 0; k < chunkCount; ++k)
+        for (const Object &object: chunks[k].objects)
+            objects.push_back({object.name, uint32_t(indexOffsets[k] / 3) + object.firstTriangle, 0});
+    for (size_t i = 0; i < objects.size(); ++i) {
+        uint32_t next = (i + 1 < objects.size()) ? objects[i + 1].firstTriangle : uint32_t(indexCount / 3);
+        objects[i].triangleCount = next - objects[i].firstTriangle;
+    }
+    objects.erase(std::remove_if(objects.begin(), objects.end(), [](const Object &object) { return object.triangleCount == 0; }),
+                  objects.end());
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vector.hpp"
+#include "global.hpp"
+
+
+/*
+OBJ Loader implementation
+CORE:
+- the file is memory mapped and split at line ends into chunks of about OBJ_CHUNK_SIZE bytes, parsed in parallel
+- numbers are parsed in place by std::from_chars, no line or token is copied
+- the chunks are merged into one indexed vertex buffer, three indices per triangle
+
+NOTE:
+- only positions and faces are read, texture coordinates, normals and materials are skipped
+- polygons are triangulated as fans, so they are expected to be convex
+- 'o' and 'g' start a new object, faces before the first one belong to an unnamed object
+- negative (relative) indices are resolved against the vertices of the whole file once the chunks are merged
+*/
+class OBJLoader {
+public:
+    struct Object {
+        std::string name;                   // empty if the faces come before any 'o' or 'g'
+        uint32_t firstTriangle, triangleCount;
+    };
+
+    std::vector<Vector3f> positions;
+    std::vector<uint32_t> indices;          // three per triangle into positions
+    std::vector<Object> objects;            // in file order, objects without faces are dropped
+
+public:
+    bool load(const std::string &filename, std::string &error);
+
+    size_t getTriangleCount() const { return indices.size() / 3; }
+};
@@ -0,0 +1,67 @@
+#include <iomanip>
+
+#include "progress.hpp"
+
+
+Progress::Progress(uint64_t _total, int _shardCount): shardCount(_shardCount), total(_total), stopping(false) {
+    shards.reset(new Shard[shardCount]);
+    if (IS_PROGRESS_JSON)
+        jsonStream.open(PROGRESS_JSON_FILENAME, std::ios::out | std::ios::app);
+}
+
+Progress::~Progress() {
+    stop();
+}
+
+void Progress::start() {
+    startTime = std::chrono::steady_clock::now();
+    stopping = false;
+    reporter = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(reporterMutex);
+        while (!stopping) {
+            reporterCondition.wait_for(lock, std::chrono::milliseconds(PROGRESS_INTERVAL_MS));
+            if (!stopping)
+                report(false);
+        }
+    });
+}
+
+void Progress::stop() {
+    if (!reporter.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(reporterMutex);
+        stopping = true;
+    }
+    reporterCondition.notify_one();
+    reporter.join();
+    report(true);
+}
+
+uint64_t Progress::processed() const {
+    uint64_t sum = 0;
+    for (int i = 0; i < shardCount; ++i)
+        sum += shards[i].count.load(std::memory_order_relaxed);
+    return sum;
+}
+
+void Progress::report(bool isFinal) {
+    uint64_t done = isFinal ? total : std::min(processed(), total);
+    float progress = (total > 0) ? done / (float)total : 1.f;
+    updateProgress(progress);
+    if (isFinal)
+        std::cout << std::endl;
+
+    if (jsonStream.is_open()) {
+        // one self-contained JSON object per line, ETA extrapolated from the average rate so far
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        double eta = (done > 0) ? elapsed * (total - done) / done : -1.0;
+        jsonStream << std::fixed << std::setprecision(3)
+                   << "{\"event\": \"" << (isFinal ? "done" : "progress") << "\", "
+                   << "\"processed\": " << done << ", "
+                   << "\"total\": " << total << ", "
+                   << "\"progress\": " << progress << ", "
+                   << "\"elapsed\": " << elapsed << ", "
+                   << "\"eta\": " << eta << "}" << std::endl;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "vector.hpp"
+#include "global.hpp"
+
+
+/*
+Progress implementation
+CORE:
+- sharded relaxed atomic counters (one cache line per render thread)
+- low-frequency reporter thread (progress bar and optional JSON-lines stream)
+
+NOTE:
+- render threads only touch their own shard, they never lock
+*/
+class Progress {
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> count{0};
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    int shardCount;
+    uint64_t total;
+
+    std::chrono::steady_clock::time_point startTime;
+    std::thread reporter;
+    std::mutex reporterMutex;
+    std::condition_variable reporterCondition;
+    bool stopping;
+
+    std::ofstream jsonStream;           // only needed by JSON-lines progress
+
+public:
+    Progress(uint64_t _total, int _shardCount);
+    ~Progress();
+
+    void start();
+    void stop();
+
+    // called by render threads, shard is the index of the calling thread
+    void add(int shard, uint64_t n = 1) {
+        shards[shard].count.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t processed() const;
+
+private:
+    void report(bool isFinal);
+};
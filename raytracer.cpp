@@ -1,72 +1,610 @@
+#include <cstdio>
+#include <algorithm>
 #include <fstream>
+#include <atomic>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 
 #include "raytracer.hpp"
 
 
+constexpr uint32_t CHECKPOINT_MAGIC = 0x4B435452;   // "RTCK"
+constexpr uint32_t CHECKPOINT_VERSION = 3;
+
+
+bool RayTracer::parseIntegrator(const std::string &name, Integrator &integrator) {
+    if (name == "whitted")
+        integrator = Integrator::WHITTED;
+    else if (name == "path")
+        integrator = Integrator::PATH;
+    else if (name == "wavefront")
+        integrator = Integrator::WAVEFRONT;
+    else
+        return false;
+    return true;
+}
+
 void RayTracer::render(const Scene &scene, const Camera &camera) {
-    frameBuffer.resize(camera.width * camera.height);
-
-    if (!IS_MULTITHREADING) {
-        for (uint32_t j = 0; j < camera.height; ++j) {
-            for (uint32_t i = 0; i < camera.width; ++i) {
-                Ray ray = camera.generateRay(i, j);
-                if (!IS_PATH) {
-                    Vector3f irradiance = scene.castRay(ray, 0);
-                    frameBuffer[j * camera.width + i] = Eigen::Vector3f(irradiance.x, irradiance.y, irradiance.z);
-                } else {
-                    Vector3f irradiance(0);
-                    for (int k = 0; k < PATH_SAMPLES; ++k) {
-                        irradiance += scene.castRay(ray, 0) / PATH_SAMPLES;
-                    }
-                    frameBuffer[j * camera.width + i] = Eigen::Vector3f(irradiance.x, irradiance.y, irradiance.z);
+    reset(camera);
+    renderPass(scene, camera, samples);
+}
+
+void RayTracer::reset(const Camera &camera) {
+    width = camera.width;
+    height = camera.height;
+    accumBuffer.assign(width * height, Eigen::Vector3f(0, 0, 0));
+    accumSquared.assign(width * height, 0.0f);
+    sampleCounts.assign(width * height, 0);
+    resetFeatures();
+}
+
+void RayTracer::resetFeatures() {
+    if (IS_DENOISE) {
+        albedoBuffer.assign(width * height, Eigen::Vector3f(0, 0, 0));
+        normalBuffer.assign(width * height, Eigen::Vector3f(0, 0, 0));
+        depthBuffer.assign(width * height, 0.0f);
+    }
+    if (aovFlags != 0)
+        aovs.reset(aovFlags, width, height, lightGroups);
+}
+
+void RayTracer::setAOVs(uint32_t flags, const Scene &scene) {
+    aovFlags = flags;
+    lightGroups = scene.getLightGroups();
+    if (width > 0)
+        resetFeatures();
+}
+
+void RayTracer::storeFeatures(uint32_t pixel, const Intersection &hit) {
+    if (aovs.isEnabled())
+        aovs.storeHit(pixel, hit);
+    if (albedoBuffer.empty())
+        return;
+    // specular surfaces and lights count as white, so the denoiser divides nothing out of them
+    Vector3f albedo = AOVBuffer::getAlbedo(hit);
+    albedoBuffer[pixel] = Eigen::Vector3f(albedo.x, albedo.y, albedo.z);
+    if (!hit.happened) {
+        normalBuffer[pixel] = Eigen::Vector3f(0, 0, 0);
+        depthBuffer[pixel] = std::numeric_limits<float>::max();
+        return;
+    }
+    normalBuffer[pixel] = Eigen::Vector3f(hit.normal.x, hit.normal.y, hit.normal.z);
+    depthBuffer[pixel] = hit.distance;
+}
+
+void RayTracer::denoise(std::vector<Eigen::Vector3f> &radiance) const {
+    Denoiser denoiser(width, height, albedoBuffer, normalBuffer, depthBuffer, getThreadCount());
+    denoiser.denoise(radiance);
+}
+
+uint32_t RayTracer::getSamples() const {
+    if (sampleCounts.empty())
+        return 0;
+    return *std::min_element(sampleCounts.begin(), sampleCounts.end());
+}
+
+uint64_t RayTracer::getTotalSamples() const {
+    uint64_t total = 0;
+    for (uint32_t count: sampleCounts)
+        total += count;
+    return total;
+}
+
+void RayTracer::renderPass(const Scene &scene, const Camera &camera, uint32_t samples, const std::vector<uint8_t> *mask) {
+    if (width != camera.width || height != camera.height || accumBuffer.empty())
+        reset(camera);
+    uint64_t pixels = (mask == nullptr) ? uint64_t(camera.width) * camera.height : std::count(mask->begin(), mask->end(), 1);
+    if (pixels == 0)
+        return;
+
+    // only the bounding box of the traced pixels is split among the threads
+    uint32_t rowBegin = 0, rowEnd = camera.height, colBegin = 0, colEnd = camera.width;
+    if (mask != nullptr) {
+        rowBegin = camera.height, rowEnd = 0, colBegin = camera.width, colEnd = 0;
+        for (uint32_t j = 0; j < uint32_t(camera.height); ++j) {
+            for (uint32_t i = 0; i < uint32_t(camera.width); ++i) {
+                if ((*mask)[j * camera.width + i]) {
+                    rowBegin = std::min(rowBegin, j), rowEnd = std::max(rowEnd, j + 1);
+                    colBegin = std::min(colBegin, i), colEnd = std::max(colEnd, i + 1);
                 }
             }
-            updateProgress(j / (float)camera.height);
         }
-        updateProgress(1.f);
-    } else {
-        std::mutex myMutex;
-        int processed = 0;
-        auto castRayMultiThreading = [&](uint32_t rowStart, uint32_t rowEnd, uint32_t colStart, uint32_t colEnd) {
-            for (uint32_t j = rowStart; j < rowEnd; ++j) {
-                for (uint32_t i = colStart; i < colEnd; ++i) {
-                    Ray ray = camera.generateRay(i, j);
-                    if (!IS_PATH) {
-                        Vector3f irradiance = scene.castRay(ray, 0);
-                        frameBuffer[j * camera.width + i] = Eigen::Vector3f(irradiance.x, irradiance.y, irradiance.z);
-                    } else {
-                        Vector3f irradiance(0);
-                        for (int k = 0; k < PATH_SAMPLES; ++k) {
-                            irradiance += scene.castRay(ray, 0) / PATH_SAMPLES;
-                        }
-                        frameBuffer[j * camera.width + i] = Eigen::Vector3f(irradiance.x, irradiance.y, irradiance.z);
-                    }
-                    myMutex.lock();
-                    ++processed;
-                    myMutex.unlock();
-                }
+    }
 
-                myMutex.lock();
-                updateProgress(processed / (float)(camera.width * camera.height));
-                myMutex.unlock();
-            }
-        };
+    if (getThreadCount() == 1) {
+        Progress progress(pixels, 1);
+        progress.start();
+        renderTile(scene, camera, rowBegin, rowEnd, colBegin, colEnd, samples, mask, progress, 0);
+        progress.stop();
+    } else {
+        Progress progress(pixels, getThreadCount());
+        progress.start();
 
         int id = 0;
-        std::thread myThreads[THREADS_X * THREADS_Y];
-        int strideX = (camera.width + 1) / THREADS_X;
-        int strideY = (camera.height + 1) / THREADS_Y;
-        for (uint32_t j = 0; j < camera.height; j += strideY) {
-            for (uint32_t i = 0; i < camera.width; i += strideX) {
-                myThreads[id] = std::thread(castRayMultiThreading, j, std::min(j + strideY, uint32_t(camera.height)), i, std::min(i + strideX, uint32_t(camera.width)));
+        std::vector<std::thread> myThreads(getThreadCount());
+        uint32_t strideX = (colEnd - colBegin + threadsX - 1) / threadsX;
+        uint32_t strideY = (rowEnd - rowBegin + threadsY - 1) / threadsY;
+        for (uint32_t j = rowBegin; j < rowEnd; j += strideY) {
+            for (uint32_t i = colBegin; i < colEnd; i += strideX) {
+                myThreads[id] = std::thread(&RayTracer::renderTile, this, std::cref(scene), std::cref(camera),
+                                            j, std::min(j + strideY, rowEnd),
+                                            i, std::min(i + strideX, colEnd),
+                                            samples, mask, std::ref(progress), id);
                 ++id;
             }
         }
 
-        for (int i = 0; i < THREADS_X * THREADS_Y; ++i)
+        for (int i = 0; i < id; ++i)
             myThreads[i].join();
-        updateProgress(1.f);
+        progress.stop();
     }
 }
+
+bool RayTracer::renderStreaming(const Scene &sharedScene, const Camera &camera, TileWriter &writer) {
+    // threads pull tiles from a shared counter, render them into their own tile buffer and hand them to the writer
+    uint32_t tilesX = (camera.width + STREAMING_TILE_SIZE - 1) / STREAMING_TILE_SIZE;
+    uint32_t tilesY = (camera.height + STREAMING_TILE_SIZE - 1) / STREAMING_TILE_SIZE;
+    std::atomic<uint32_t> nextTile(0);
+    std::atomic<bool> isWritten(true);
+    int threadCount = getThreadCount();
+    Progress progress(uint64_t(camera.width) * camera.height, threadCount);
+
+    auto worker = [&](int shard) {
+        NumaPlacement::Binding binding(placement, shard, sharedScene);
+        const Scene &scene = binding.getScene();
+        Scene::Tracer tracer = scene.getTracer(integrator != Integrator::WHITTED);
+        std::vector<Eigen::Vector3f> tile;
+        for (uint32_t t = nextTile++; t < tilesX * tilesY; t = nextTile++) {
+            uint32_t x0 = (t % tilesX) * STREAMING_TILE_SIZE, y0 = (t / tilesX) * STREAMING_TILE_SIZE;
+            uint32_t tileWidth = std::min<uint32_t>(STREAMING_TILE_SIZE, camera.width - x0);
+            uint32_t tileHeight = std::min<uint32_t>(STREAMING_TILE_SIZE, camera.height - y0);
+            tile.resize(tileWidth * tileHeight);
+            for (uint32_t j = 0; j < tileHeight; ++j) {
+                for (uint32_t i = 0; i < tileWidth; ++i) {
+                    float squared;
+                    Intersection hit;
+                    Vector3f irradiance = tracePixel(scene, tracer, camera, x0 + i, y0 + j, 0, samples, squared, hit) / samples;
+                    tile[j * tileWidth + i] = Eigen::Vector3f(irradiance.x, irradiance.y, irradiance.z);
+                }
+                progress.add(shard, tileWidth);
+            }
+            if (!writer.write(x0, y0, tileWidth, tileHeight, tile))
+                isWritten = false;
+        }
+    };
+
+    progress.start();
+    std::vector<std::thread> myThreads;
+    for (int i = 0; i < threadCount; ++i)
+        myThreads.emplace_back(worker, i);
+    for (auto &thread: myThreads)
+        thread.join();
+    progress.stop();
+    return isWritten;
+}
+
+void RayTracer::renderSequence(const Scene &sharedScene, const CameraPath &path, ImageWriter &writer, const std::string &filenamePattern) {
+    // the threads live for the whole sequence and pull tiles of consecutive frames from a shared counter,
+    // so the next frame starts as soon as the last tiles of the current one are taken
+    int frameCount = path.getFrameCount();
+    width = path.width;
+    height = path.height;
+    uint32_t tilesX = (width + SEQUENCE_TILE_SIZE - 1) / SEQUENCE_TILE_SIZE;
+    uint32_t tilesY = (height + SEQUENCE_TILE_SIZE - 1) / SEQUENCE_TILE_SIZE;
+    uint32_t tilesPerFrame = tilesX * tilesY;
+    int threadCount = getThreadCount();
+
+    // SEQUENCE_FRAMES_IN_FLIGHT frame buffers are reused round robin, a tile waits until its frame owns the slot
+    struct Slot {
+        int frame;
+        uint32_t remaining;         // tiles not finished yet
+        std::vector<Eigen::Vector3f> radiance;
+    };
+    std::vector<Slot> slots(SEQUENCE_FRAMES_IN_FLIGHT);
+    for (int s = 0; s < SEQUENCE_FRAMES_IN_FLIGHT; ++s)
+        slots[s] = Slot{s, tilesPerFrame, std::vector<Eigen::Vector3f>(width * height)};
+    std::mutex slotsMutex;
+    std::condition_variable slotsCondition;
+    std::atomic<uint64_t> nextTile(0);
+    Progress progress(uint64_t(width) * height * frameCount, threadCount);
+
+    auto worker = [&](int shard) {
+        NumaPlacement::Binding binding(placement, shard, sharedScene);
+        const Scene &scene = binding.getScene();
+        Scene::Tracer tracer = scene.getTracer(integrator != Integrator::WHITTED);
+        for (uint64_t t = nextTile++; t < uint64_t(tilesPerFrame) * frameCount; t = nextTile++) {
+            int frame = t / tilesPerFrame;
+            uint32_t tile = t % tilesPerFrame;
+            Slot &slot = slots[frame % SEQUENCE_FRAMES_IN_FLIGHT];
+            {
+                std::unique_lock<std::mutex> lock(slotsMutex);
+                slotsCondition.wait(lock, [&]() { return slot.frame == frame; });
+            }
+
+            Camera camera = path.at(frame);
+            uint32_t x0 = (tile % tilesX) * SEQUENCE_TILE_SIZE, y0 = (tile / tilesX) * SEQUENCE_TILE_SIZE;
+            uint32_t x1 = std::min<uint32_t>(x0 + SEQUENCE_TILE_SIZE, width), y1 = std::min<uint32_t>(y0 + SEQUENCE_TILE_SIZE, height);
+            for (uint32_t j = y0; j < y1; ++j) {
+                for (uint32_t i = x0; i < x1; ++i) {
+                    float squared;
+                    Intersection hit;
+                    // Whitted-style frames cycle through the sets of virtual point lights
+                    Vector3f irradiance = tracePixel(scene, tracer, camera, i, j, (integrator == Integrator::WHITTED) ? frame : 0, samples, squared, hit) / samples;
+                    slot.radiance[j * width + i] = Eigen::Vector3f(irradiance.x, irradiance.y, irradiance.z);
+                }
+                progress.add(shard, x1 - x0);
+            }
+
+            bool isLast;
+            {
+                std::lock_guard<std::mutex> lock(slotsMutex);
+                isLast = --slot.remaining == 0;
+            }
+            if (!isLast)
+                continue;
+            // the frame is complete, hand it to the writer and pass the slot on to a later frame
+            std::vector<Eigen::Vector3f> finished(width * height);
+            std::swap(finished, slot.radiance);
+            char filename[1024];
+            std::snprintf(filename, sizeof(filename), filenamePattern.c_str(), frame);
+            writer.submit(filename, std::move(finished), width, height);
+            {
+                std::lock_guard<std::mutex> lock(slotsMutex);
+                slot.frame += SEQUENCE_FRAMES_IN_FLIGHT;
+                slot.remaining = tilesPerFrame;
+            }
+            slotsCondition.notify_all();
+        }
+    };
+
+    progress.start();
+    std::vector<std::thread> myThreads;
+    for (int i = 0; i < threadCount; ++i)
+        myThreads.emplace_back(worker, i);
+    for (auto &thread: myThreads)
+        thread.join();
+    progress.stop();
+}
+
+void RayTracer::renderRegions(const Scene &scene, const Camera &camera, const std::vector<Region> &regions, uint32_t samples) {
+    // the camera is unchanged, so the regions line up exactly with a full frame
+    reset(camera);
+    std::vector<uint8_t> mask(width * height, 0);
+    for (const Region &region: regions) {
+        for (uint32_t j = region.y0; j < std::min<uint32_t>(region.y1, height); ++j)
+            for (uint32_t i = region.x0; i < std::min<uint32_t>(region.x1, width); ++i)
+                mask[j * width + i] = 1;
+    }
+    renderPass(scene, camera, samples, &mask);
+}
+
+void RayTracer::renderAdaptive(const Scene &scene, const Camera &camera) {
+    reset(camera);
+    renderPass(scene, camera, ADAPTIVE_BASE_SAMPLES);
+
+    // a tile stays active while the average error of its pixels is above the threshold
+    std::vector<float> errors;
+    std::vector<uint8_t> activeTiles, mask;
+    while (true) {
+        estimateTileErrors(errors);
+        activeTiles.assign(errors.size(), 0);
+        for (uint32_t t = 0; t < errors.size(); ++t)
+            activeTiles[t] = errors[t] > ADAPTIVE_THRESHOLD;
+        if (std::count(activeTiles.begin(), activeTiles.end(), 1) == 0)
+            break;
+        fillTileMask(activeTiles, mask);
+        renderPass(scene, camera, ADAPTIVE_PASS_SAMPLES, &mask);
+    }
+}
+
+RayTracer::RenderStats RayTracer::renderTimed(const Scene &scene, const Camera &camera, std::chrono::steady_clock::time_point _deadline) {
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    RenderStats stats;
+
+    // the first pass always completes, so every pixel has at least one sample
+    reset(camera);
+    renderPass(scene, camera, 1);
+    ++stats.passes;
+    deadline = _deadline;
+
+    // uniform passes while the next one is expected to fit in the budget
+    double secondsPerSample = std::chrono::duration<double>(Clock::now() - start).count() / (double(width) * height);
+    while (Clock::now() + std::chrono::duration<double>(secondsPerSample * width * height * TIMED_PASS_SAMPLES) < deadline) {
+        auto passStart = Clock::now();
+        renderPass(scene, camera, TIMED_PASS_SAMPLES);
+        ++stats.passes;
+        secondsPerSample = std::chrono::duration<double>(Clock::now() - passStart).count() / (double(width) * height * TIMED_PASS_SAMPLES);
+    }
+
+    // spend the remaining time on the noisiest tiles, as many as are expected to fit
+    std::vector<float> errors;
+    std::vector<uint8_t> activeTiles, mask;
+    std::vector<uint32_t> order;
+    uint32_t tilePixels = ADAPTIVE_TILE_SIZE * ADAPTIVE_TILE_SIZE;
+    while (Clock::now() < deadline) {
+        estimateTileErrors(errors);
+        order.resize(errors.size());
+        for (uint32_t t = 0; t < order.size(); ++t)
+            order[t] = t;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return errors[a] > errors[b]; });
+
+        double remaining = std::chrono::duration<double>(deadline - Clock::now()).count();
+        uint32_t affordable = std::max<uint32_t>(1, remaining / (secondsPerSample * tilePixels * TIMED_PASS_SAMPLES));
+        activeTiles.assign(errors.size(), 0);
+        uint32_t active = 0;
+        for (uint32_t t = 0; t < order.size() && active < affordable && errors[order[t]] > 0; ++t, ++active)
+            activeTiles[order[t]] = 1;
+        if (active == 0)
+            break;
+        fillTileMask(activeTiles, mask);
+        renderPass(scene, camera, TIMED_PASS_SAMPLES, &mask);
+        ++stats.passes;
+    }
+    deadline = Clock::time_point::max();
+
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stats.minSamples = *std::min_element(sampleCounts.begin(), sampleCounts.end());
+    stats.maxSamples = *std::max_element(sampleCounts.begin(), sampleCounts.end());
+    stats.meanSamples = getTotalSamples() / (double(width) * height);
+    return stats;
+}
+
+void RayTracer::estimateTileErrors(std::vector<float> &errors) const {
+    uint32_t tilesX = (width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    uint32_t tilesY = (height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    errors.assign(tilesX * tilesY, 0.0f);
+    for (uint32_t ty = 0; ty < tilesY; ++ty) {
+        for (uint32_t tx = 0; tx < tilesX; ++tx) {
+            uint32_t rowEnd = std::min<uint32_t>((ty + 1) * ADAPTIVE_TILE_SIZE, height);
+            uint32_t colEnd = std::min<uint32_t>((tx + 1) * ADAPTIVE_TILE_SIZE, width);
+            float error = 0.0f;
+            uint32_t minSamples = ADAPTIVE_MAX_SAMPLES;
+            for (uint32_t j = ty * ADAPTIVE_TILE_SIZE; j < rowEnd; ++j) {
+                for (uint32_t i = tx * ADAPTIVE_TILE_SIZE; i < colEnd; ++i) {
+                    error += estimateError(j * width + i);
+                    minSamples = std::min(minSamples, sampleCounts[j * width + i]);
+                }
+            }
+            error /= (rowEnd - ty * ADAPTIVE_TILE_SIZE) * (colEnd - tx * ADAPTIVE_TILE_SIZE);
+            errors[ty * tilesX + tx] = (minSamples < ADAPTIVE_MAX_SAMPLES) ? error : 0.0f;
+        }
+    }
+}
+
+void RayTracer::fillTileMask(const std::vector<uint8_t> &activeTiles, std::vector<uint8_t> &mask) const {
+    uint32_t tilesX = (width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    mask.assign(width * height, 0);
+    for (int j = 0; j < height; ++j)
+        for (int i = 0; i < width; ++i)
+            mask[j * width + i] = activeTiles[(j / ADAPTIVE_TILE_SIZE) * tilesX + i / ADAPTIVE_TILE_SIZE];
+}
+
+float RayTracer::estimateError(uint32_t pixel) const {
+    uint32_t n = sampleCounts[pixel];
+    if (n < 2)
+        return kInfinity;
+    const Eigen::Vector3f &sum = accumBuffer[pixel];
+    float mean = (0.2126f * sum.x() + 0.7152f * sum.y() + 0.0722f * sum.z()) / n;
+    float variance = std::max(0.0f, (accumSquared[pixel] / n - mean * mean) * n / (n - 1));
+    // the offset keeps nearly black pixels from demanding unbounded samples
+    return std::sqrt(variance / n) / (mean + ADAPTIVE_MIN_LUMINANCE);
+}
+
+void RayTracer::renderTile(const Scene &sharedScene, const Camera &camera, uint32_t rowStart, uint32_t rowEnd,
+                           uint32_t colStart, uint32_t colEnd, uint32_t sampleCount, const std::vector<uint8_t> *mask,
+                           Progress &progress, int shard) {
+    // with a NUMA placement the thread traverses the scene copy of its node, pinned only for this tile
+    NumaPlacement::Binding binding(placement, shard, sharedScene);
+    const Scene &scene = binding.getScene();
+    // the wavefront kernels do not split the radiance, tiles with lighting AOVs take the scalar path
+    if (integrator == Integrator::WAVEFRONT && !aovs.isSplit()) {
+        renderTileWavefront(scene, camera, rowStart, rowEnd, colStart, colEnd, sampleCount, mask, progress, shard);
+        return;
+    }
+
+    Scene::Tracer tracer = scene.getTracer(integrator != Integrator::WHITTED);
+    RadianceSplit split;        // only needed by AOVs
+    for (uint32_t j = rowStart; j < rowEnd; ++j) {
+        for (uint32_t i = colStart; i < colEnd; ++i) {
+            uint32_t pixel = j * camera.width + i;
+            if (mask != nullptr && !(*mask)[pixel])
+                continue;
+            if (sampleCounts[pixel] > 0 && std::chrono::steady_clock::now() >= deadline)
+                continue;
+            float squared = 0.0f;
+            Intersection hit;
+            Vector3f irradiance = tracePixel(scene, tracer, camera, i, j, sampleOffset + sampleCounts[pixel], sampleCount, squared, hit,
+                                             aovs.isSplit() ? &split : nullptr);
+            if (!albedoBuffer.empty() || aovs.isEnabled())
+                storeFeatures(pixel, hit);
+            if (aovs.isSplit())
+                aovs.addSplit(pixel, split, sampleCount);
+            accumBuffer[pixel] += Eigen::Vector3f(irradiance.x, irradiance.y, irradiance.z);
+            accumSquared[pixel] += squared;
+            sampleCounts[pixel] += sampleCount;
+            progress.add(shard);
+        }
+    }
+}
+
+Vector3f RayTracer::tracePixel(const Scene &scene, const Scene::Tracer &tracer, const Camera &camera, uint32_t i, uint32_t j,
+                               uint32_t sampleStart, uint32_t sampleCount, float &squared, Intersection &hit,
+                               RadianceSplit *split) const {
+    // Whitted renders one deterministic sample, without jitter the camera ray is the same for every sample
+    // and its hit is cached across the samples
+    bool isJitter = camera.isJitter && integrator != Integrator::WHITTED;
+    Ray ray = camera.generateRay(i, j);
+    if (!isJitter)
+        hit = (scene.*tracer.intersect)(ray);
+    Vector3f irradiance(0);
+    squared = 0.0f;
+    if (split != nullptr) {
+        split->direct = split->indirect = Vector3f(0.0f);
+        split->groups.assign(lightGroups.size(), Vector3f(0.0f));
+    }
+    for (uint32_t k = sampleStart; k < sampleStart + sampleCount; ++k) {
+        seedRandom(i, j, k);
+        Intersection jitteredHit;
+        if (isJitter) {
+            ray = camera.generateRay(i, j, camera.samplePixel());
+            jitteredHit = (scene.*tracer.intersect)(ray);
+            // the features follow the first sample
+            if (k == sampleStart)
+                hit = jitteredHit;
+        }
+        Vector3f sample = (scene.*tracer.trace)(ray, isJitter ? jitteredHit : hit, split);
+        float luminance = 0.2126f * sample.x + 0.7152f * sample.y + 0.0722f * sample.z;
+        irradiance += sample;
+        squared += luminance * luminance;
+    }
+    return irradiance;
+}
+
+void RayTracer::renderTileWavefront(const Scene &scene, const Camera &camera, uint32_t rowStart, uint32_t rowEnd,
+                                    uint32_t colStart, uint32_t colEnd, uint32_t sampleCount, const std::vector<uint8_t> *mask,
+                                    Progress &progress, int shard) {
+    // the camera samples of whole pixels are traced together, the threads share WAVEFRONT_SIZE paths in flight
+    WavefrontIntegrator integrator(scene, camera);
+    uint32_t pixelsPerWave = std::max<uint32_t>(1, WAVEFRONT_SIZE / getThreadCount() / sampleCount);
+    std::vector<WavefrontIntegrator::CameraSample> samples;
+    std::vector<uint32_t> pixels;
+    std::vector<Vector3f> radiance;
+
+    std::vector<Intersection> primary;
+
+    auto flush = [&]() {
+        bool isFeatures = !albedoBuffer.empty() || aovs.isEnabled();
+        integrator.trace(samples, radiance, isFeatures ? &primary : nullptr);
+        for (uint32_t p = 0; p < pixels.size(); ++p) {
+            uint32_t pixel = pixels[p];
+            if (isFeatures)
+                storeFeatures(pixel, primary[p * sampleCount]);
+            Vector3f irradiance(0);
+            float squared = 0.0f;
+            for (uint32_t k = 0; k < sampleCount; ++k) {
+                const Vector3f &sample = radiance[p * sampleCount + k];
+                float luminance = 0.2126f * sample.x + 0.7152f * sample.y + 0.0722f * sample.z;
+                irradiance += sample;
+                squared += luminance * luminance;
+            }
+            accumBuffer[pixel] += Eigen::Vector3f(irradiance.x, irradiance.y, irradiance.z);
+            accumSquared[pixel] += squared;
+            sampleCounts[pixel] += sampleCount;
+        }
+        progress.add(shard, pixels.size());
+        samples.clear();
+        pixels.clear();
+    };
+
+    for (uint32_t j = rowStart; j < rowEnd; ++j) {
+        for (uint32_t i = colStart; i < colEnd; ++i) {
+            uint32_t pixel = j * camera.width + i;
+            if (mask != nullptr && !(*mask)[pixel])
+                continue;
+            if (sampleCounts[pixel] > 0 && std::chrono::steady_clock::now() >= deadline)
+                continue;
+            pixels.push_back(pixel);
+            for (uint32_t k = 0; k < sampleCount; ++k)
+                samples.push_back({i, j, sampleOffset + sampleCounts[pixel] + k});
+            if (pixels.size() == pixelsPerWave)
+                flush();
+        }
+    }
+    if (!pixels.empty())
+        flush();
+}
+
+bool RayTracer::saveCheckpoint(const std::string &filename) const {
+    // write to a temporary file first, so an interruption never corrupts the last checkpoint
+    std::string temporary = filename + ".tmp";
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file)
+        return false;
+    uint32_t header[5] = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, uint32_t(width), uint32_t(height), configHash};
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(accumBuffer.data()), accumBuffer.size() * sizeof(Eigen::Vector3f));
+    file.write(reinterpret_cast<const char *>(accumSquared.data()), accumSquared.size() * sizeof(float));
+    file.write(reinterpret_cast<const char *>(sampleCounts.data()), sampleCounts.size() * sizeof(uint32_t));
+    file.close();
+    if (!file)
+        return false;
+    return std::rename(temporary.c_str(), filename.c_str()) == 0;
+}
+
+bool RayTracer::loadCheckpoint(const std::string &filename, const Camera &camera) {
+    RayTracer loaded;
+    if (!loaded.readAccumulation(filename) || loaded.width != camera.width || loaded.height != camera.height ||
+        loaded.configHash != configHash)
+        return false;
+
+    width = loaded.width;
+    height = loaded.height;
+    accumBuffer = std::move(loaded.accumBuffer);
+    accumSquared = std::move(loaded.accumSquared);
+    sampleCounts = std::move(loaded.sampleCounts);
+    resetFeatures();
+    return true;
+}
+
+void RayTracer::renderPartial(const Scene &scene, const Camera &camera, uint32_t tileBegin, uint32_t tileEnd,
+                              uint32_t sampleBegin, uint32_t sampleEnd) {
+    reset(camera);
+    uint32_t tilesX = (width + DISTRIBUTED_TILE_SIZE - 1) / DISTRIBUTED_TILE_SIZE;
+    std::vector<uint8_t> mask(width * height, 0);
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            uint32_t tile = (j / DISTRIBUTED_TILE_SIZE) * tilesX + i / DISTRIBUTED_TILE_SIZE;
+            mask[j * width + i] = tile >= tileBegin && tile < tileEnd;
+        }
+    }
+    sampleOffset = sampleBegin;
+    renderPass(scene, camera, sampleEnd - sampleBegin, &mask);
+    sampleOffset = 0;
+}
+
+bool RayTracer::mergePartial(const std::string &filename) {
+    RayTracer partial;
+    if (!partial.readAccumulation(filename))
+        return false;
+    if (accumBuffer.empty()) {
+        width = partial.width;
+        height = partial.height;
+        configHash = partial.configHash;
+        accumBuffer.assign(width * height, Eigen::Vector3f(0, 0, 0));
+        accumSquared.assign(width * height, 0.0f);
+        sampleCounts.assign(width * height, 0);
+    } else if (partial.width != width || partial.height != height || partial.configHash != configHash) {
+        return false;
+    }
+
+    // sums and counts simply add up, every pixel is then weighted by its own total sample count
+    for (uint32_t i = 0; i < accumBuffer.size(); ++i) {
+        accumBuffer[i] += partial.accumBuffer[i];
+        accumSquared[i] += partial.accumSquared[i];
+        sampleCounts[i] += partial.sampleCounts[i];
+    }
+    return true;
+}
+
+bool RayTracer::readAccumulation(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+    uint32_t header[5];
+    file.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (!file || header[0] != CHECKPOINT_MAGIC || header[1] != CHECKPOINT_VERSION)
+        return false;
+
+    width = header[2];
+    height = header[3];
+    configHash = header[4];
+    accumBuffer.resize(width * height);
+    accumSquared.resize(width * height);
+    sampleCounts.resize(width * height);
+    file.read(reinterpret_cast<char *>(accumBuffer.data()), accumBuffer.size() * sizeof(Eigen::Vector3f));
+    file.read(reinterpret_cast<char *>(accumSquared.data()), accumSquared.size() * sizeof(float));
+    file.read(reinterpret_cast<char *>(sampleCounts.data()), sampleCounts.size() * sizeof(uint32_t));
+    return bool(file);
+}
@@ -1,41 +1,199 @@
 #pragma once
 
+#include <chrono>
+#include <string>
+
 #include <eigen3/Eigen/Eigen>
 
 #include "vector.hpp"
 #include "global.hpp"
 #include "scene.hpp"
 #include "camera.hpp"
+#include "progress.hpp"
+#include "wavefront.hpp"
+#include "tilewriter.hpp"
+#include "imagewriter.hpp"
+#include "numa.hpp"
+#include "denoiser.hpp"
+#include "aov.hpp"
 
 
 /*
 RayTracer implementation
-CORE: 
+CORE:
 - ray tracing
+- progressive accumulation (with checkpoint and resume)
+- adaptive sampling (driven by per-pixel variance estimates)
+- time-budgeted rendering
+- distributed rendering (partial results of tile or sample ranges, and their merge)
+- region of interest rendering
+- streaming tile output (without any full frame buffer)
+- animation sequence rendering (with one resident thread pool)
+- NUMA-aware worker pinning and scene placement
+- denoising (guided by albedo, normal and depth of the first hit)
+- arbitrary output variables (written from the camera ray hit and the radiance split of the samples)
 - GAMMA correction
 */
 class RayTracer {
+public:
+    struct RenderStats {
+        int passes = 0;
+        double seconds = 0.0;
+        uint32_t minSamples = 0, maxSamples = 0;    // samples per pixel achieved
+        double meanSamples = 0.0;
+    };
+
+    struct Region {
+        uint32_t x0, y0, x1, y1;        // pixel rectangle [x0, x1) x [y0, y1)
+    };
+
+    enum class Integrator { WHITTED, PATH, WAVEFRONT };
+
 private:
+    int width = 0, height = 0;
     std::vector<Eigen::Vector3f> frameBuffer;
+    std::vector<Eigen::Vector3f> accumBuffer;       // sum of all samples so far
+    std::vector<float> accumSquared;                // sum of squared sample luminance, only needed by adaptive sampling
+    std::vector<uint32_t> sampleCounts;             // samples inside accumBuffer of each pixel
+    uint32_t sampleOffset = 0;                      // first sample index, only needed by distributed rendering
+    // first hit features, written by every pass, only needed by denoising
+    std::vector<Eigen::Vector3f> albedoBuffer, normalBuffer;
+    std::vector<float> depthBuffer;
+    // only needed by AOVs
+    AOVBuffer aovs;
+    uint32_t aovFlags = 0;
+    std::vector<std::string> lightGroups;
+    // pixels which already have a sample are skipped after it, only needed by time-budgeted rendering
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    const NumaPlacement *placement = nullptr;       // only needed by NUMA-aware rendering
+    Integrator integrator = IS_PATH ? (IS_WAVEFRONT ? Integrator::WAVEFRONT : Integrator::PATH) : Integrator::WHITTED;
+    uint32_t samples = IS_PATH ? PATH_SAMPLES : 1;  // per pixel of render, streaming and sequence rendering
+    int threadsX = IS_MULTITHREADING ? THREADS_X : 1, threadsY = IS_MULTITHREADING ? THREADS_Y : 1;
+    uint32_t configHash = 0;                        // checkpoints and partial results only mix with equal hashes
 
 public:
+    // whitted, path or wavefront
+    static bool parseIntegrator(const std::string &name, Integrator &integrator);
+
     void render(const Scene &scene, const Camera &camera);
+    // add samples per pixel on top of the accumulation, sample indices continue from the last pass
+    // only pixels set in mask are traced if it is given
+    void renderPass(const Scene &scene, const Camera &camera, uint32_t samples, const std::vector<uint8_t> *mask = nullptr);
+    // base pass, then extra passes on tiles whose average error estimate is above ADAPTIVE_THRESHOLD
+    void renderAdaptive(const Scene &scene, const Camera &camera);
+    // passes until the deadline, the remaining time goes to the noisiest tiles, the first pass of one sample
+    // per pixel is always completed, so a budget shorter than that pass is overrun by the rest of it
+    RenderStats renderTimed(const Scene &scene, const Camera &camera, std::chrono::steady_clock::time_point _deadline);
+    // only trace the pixels inside the regions, the others stay without samples
+    void renderRegions(const Scene &scene, const Camera &camera, const std::vector<Region> &regions, uint32_t samples);
+    // render STREAMING_TILE_SIZE tiles straight to the writer, memory is bounded by the tiles in flight
+    bool renderStreaming(const Scene &scene, const Camera &camera, TileWriter &writer);
+    // render every frame of the path, filenamePattern gets the frame number, e.g. "frame_%04d.png"
+    void renderSequence(const Scene &scene, const CameraPath &path, ImageWriter &writer, const std::string &filenamePattern);
+    // render DISTRIBUTED_TILE_SIZE tiles [tileBegin, tileEnd) with sample indices [sampleBegin, sampleEnd)
+    void renderPartial(const Scene &scene, const Camera &camera, uint32_t tileBegin, uint32_t tileEnd,
+                       uint32_t sampleBegin, uint32_t sampleEnd);
+    void reset(const Camera &camera);
+    // pin the workers and give them the scene copy of their node, nullptr restores the shared scene
+    void setPlacement(const NumaPlacement *_placement) { placement = _placement; }
+    void setIntegrator(Integrator _integrator) { integrator = _integrator; }
+    void setSamples(uint32_t _samples) { samples = _samples; }
+    // grid of worker threads a pass is split into, 1 x 1 renders on the calling thread
+    void setThreads(int x, int y) { threadsX = x, threadsY = y; }
+    int getThreadCount() const { return threadsX * threadsY; }
+    // fingerprint of the scene and settings the accumulation is rendered with, see Config::getHash
+    void setConfigHash(uint32_t hash) { configHash = hash; }
+    // flags of AOVBuffer, the scene gives the light groups
+    void setAOVs(uint32_t flags, const Scene &scene);
+    // multi-channel OpenEXR with the image and every AOV, the image is not denoised so the lighting AOVs
+    // sum back to it, with IS_DENOISE the denoised image is an extra layer
+    bool saveAOVs(const std::string &filename) const {
+        std::vector<Eigen::Vector3f> beauty = average();
+        if (!IS_DENOISE || albedoBuffer.size() != beauty.size())
+            return aovs.write(filename, beauty);
+        std::vector<Eigen::Vector3f> denoised = beauty;
+        denoise(denoised);
+        return aovs.write(filename, beauty, &denoised);
+    }
 
-    std::vector<Eigen::Vector3f> &capture() {
-        uint32_t frameSize = frameBuffer.size();
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    uint32_t getSamples() const;            // samples every pixel has at least
+    uint64_t getTotalSamples() const;
+    const std::vector<uint32_t> &getSampleCounts() const { return sampleCounts; }
+
+    // a checkpoint is only resumed by a render of the same size and configuration hash
+    bool saveCheckpoint(const std::string &filename) const;
+    bool loadCheckpoint(const std::string &filename, const Camera &camera);
+    // partial results are checkpoints, merging adds one on top of the accumulation,
+    // the first partial decides the size and configuration hash the others have to match
+    bool mergePartial(const std::string &filename);
+
+    // clamp and GAMMA correct linear radiance to [0, 255]
+    static Eigen::Vector3f toneMap(const Eigen::Vector3f &color) {
         if (!IS_GAMMA) {
-            for (uint32_t i = 0; i < frameSize; ++i) {
-                frameBuffer[i] = Eigen::Vector3f(255 * clamp(0, 1, frameBuffer[i].x()), 
-                                                 255 * clamp(0, 1, frameBuffer[i].y()), 
-                                                 255 * clamp(0, 1, frameBuffer[i].z()));
-            }
+            return Eigen::Vector3f(255 * clamp(0, 1, color.x()),
+                                   255 * clamp(0, 1, color.y()),
+                                   255 * clamp(0, 1, color.z()));
         } else {
-            for (uint32_t i = 0; i < frameSize; ++i) {
-                frameBuffer[i] = Eigen::Vector3f(255 * std::pow(clamp(0, 1, frameBuffer[i].x()), GAMMA_VALUE_R), 
-                                                 255 * std::pow(clamp(0, 1, frameBuffer[i].y()), GAMMA_VALUE_G), 
-                                                 255 * std::pow(clamp(0, 1, frameBuffer[i].z()), GAMMA_VALUE_B));
-            }
+            return Eigen::Vector3f(255 * std::pow(clamp(0, 1, color.x()), GAMMA_VALUE_R),
+                                   255 * std::pow(clamp(0, 1, color.y()), GAMMA_VALUE_G),
+                                   255 * std::pow(clamp(0, 1, color.z()), GAMMA_VALUE_B));
         }
+    }
+
+    // linear radiance of the accumulation, the plain average of the samples of every pixel
+    std::vector<Eigen::Vector3f> average() const {
+        uint32_t frameSize = accumBuffer.size();
+        std::vector<Eigen::Vector3f> radiance(frameSize);
+        for (uint32_t i = 0; i < frameSize; ++i)
+            radiance[i] = (sampleCounts[i] > 0) ? Eigen::Vector3f(accumBuffer[i] / sampleCounts[i]) : Eigen::Vector3f(0, 0, 0);
+        return radiance;
+    }
+
+    // linear radiance of the accumulation (denoised if IS_DENOISE),
+    // a copy so the next pass can start while it is being written
+    std::vector<Eigen::Vector3f> resolve() const {
+        std::vector<Eigen::Vector3f> radiance = average();
+        if (IS_DENOISE && albedoBuffer.size() == radiance.size())
+            denoise(radiance);
+        return radiance;
+    }
+
+    std::vector<Eigen::Vector3f> &capture() {
+        // resolve the accumulation, so capture can be called after every pass
+        frameBuffer = resolve();
+        uint32_t frameSize = frameBuffer.size();
+        for (uint32_t i = 0; i < frameSize; ++i)
+            frameBuffer[i] = toneMap(frameBuffer[i]);
         return frameBuffer;
     }
+
+private:
+    void renderTile(const Scene &scene, const Camera &camera, uint32_t rowStart, uint32_t rowEnd,
+                    uint32_t colStart, uint32_t colEnd, uint32_t sampleCount, const std::vector<uint8_t> *mask,
+                    Progress &progress, int shard);
+    // sum of the samples [sampleStart, sampleStart + sampleCount) of a pixel, hit receives the camera ray hit
+    // and split receives the same sum split by light if it is given
+    Vector3f tracePixel(const Scene &scene, const Scene::Tracer &tracer, const Camera &camera, uint32_t i, uint32_t j,
+                        uint32_t sampleStart, uint32_t sampleCount, float &squared, Intersection &hit,
+                        RadianceSplit *split = nullptr) const;
+    // only needed by denoising and AOVs
+    void resetFeatures();
+    void storeFeatures(uint32_t pixel, const Intersection &hit);
+    void denoise(std::vector<Eigen::Vector3f> &radiance) const;
+    // only needed by wavefront path tracing
+    void renderTileWavefront(const Scene &scene, const Camera &camera, uint32_t rowStart, uint32_t rowEnd,
+                             uint32_t colStart, uint32_t colEnd, uint32_t sampleCount, const std::vector<uint8_t> *mask,
+                             Progress &progress, int shard);
+
+    // relative standard error of the mean luminance of a pixel
+    float estimateError(uint32_t pixel) const;
+    // average error of every ADAPTIVE_TILE_SIZE tile, tiles with ADAPTIVE_MAX_SAMPLES report zero
+    void estimateTileErrors(std::vector<float> &errors) const;
+    void fillTileMask(const std::vector<uint8_t> &activeTiles, std::vector<uint8_t> &mask) const;
+
+    bool readAccumulation(const std::string &filename);
+
+friend class RenderServer;
 };
@@ -0,0 +1,224 @@
+#include <cmath>
+#include <vector>
+
+#include "vector.hpp"
+#include "global.hpp"
+#include "sampler.hpp"
+
+
+static const int HALTON_BASES = 128;
+static const int MASK_BITS = 6;                 // the blue noise mask is 64x64
+static const int MASK_SIZE = 1 << MASK_BITS;
+
+
+static Sampler::Type getDefaultType() {
+    Sampler::Type type = Sampler::Type::RANDOM;
+    Sampler::parseType(SAMPLER, type);
+    return type;
+}
+
+Sampler::Type Sampler::type = getDefaultType();
+
+
+static uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    // Laine-Karras style hash on the reversed bits flips every bit depending on the bits above it only,
+    // which is Owen scrambling, and as a permutation of indices it keeps aligned power of two blocks together
+    x = reverseBits(x);
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return reverseBits(x);
+}
+
+static uint32_t sobolSecondDimension(uint32_t index) {
+    // the first dimension is the bit-reversed index, the generator matrix of the second is built by v ^= v >> 1
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+        if (index & 1)
+            result ^= v;
+    return result;
+}
+
+static float toFloat(uint32_t bits) {
+    return (bits >> 8) * 0x1p-24f;
+}
+
+bool Sampler::parseType(const std::string &name, Type &type) {
+    if (name == "random")
+        type = Type::RANDOM;
+    else if (name == "sobol")
+        type = Type::SOBOL;
+    else if (name == "halton")
+        type = Type::HALTON;
+    else if (name == "bluenoise")
+        type = Type::BLUE_NOISE;
+    else
+        return false;
+    return true;
+}
+
+const char *Sampler::getTypeName(Type type) {
+    switch (type) {
+        case Type::RANDOM: return "random";
+        case Type::SOBOL: return "sobol";
+        case Type::HALTON: return "halton";
+        case Type::BLUE_NOISE: return "bluenoise";
+    }
+    return "random";
+}
+
+void Sampler::setType(Type _type) {
+    type = _type;
+    // build the mask before rendering instead of inside the first worker
+    if (type == Type::BLUE_NOISE)
+        getBlueNoiseMask();
+}
+
+float Sampler::get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) {
+    uint32_t pixelSeed = pcgHash(x + pcgHash(y + pcgHash(RANDOM_SEED)));
+    switch (type) {
+        case Type::SOBOL:
+            return getSobol(sample, dimension, pixelSeed);
+        case Type::HALTON:
+        {
+            if (dimension >= HALTON_BASES)
+                break;
+            return getHalton(sample, dimension, pcgHash(pixelSeed + pcgHash(dimension)));
+        }
+        case Type::BLUE_NOISE:
+        {
+            // one sequence for all pixels, each dimension reads the mask at its own toroidal offset
+            uint32_t sequenceSeed = pcgHash(RANDOM_SEED);
+            uint32_t offset = pcgHash(dimension + sequenceSeed);
+            uint32_t maskX = (x + offset) & (MASK_SIZE - 1), maskY = (y + (offset >> 16)) & (MASK_SIZE - 1);
+            float rotation = getBlueNoiseMask()[maskY * MASK_SIZE + maskX];
+            float value = getSobol(sample, dimension, sequenceSeed) + rotation;
+            return (value < 1.0f) ? value : std::min(value - 1.0f, 0x1.fffffep-1f);
+        }
+        default:
+            break;
+    }
+    return toFloat(pcgHash(pixelSeed + pcgHash(sample + pcgHash(dimension + RANDOM_SEED))));
+}
+
+float Sampler::getSobol(uint32_t sample, uint32_t dimension, uint32_t seed) {
+    uint32_t pairSeed = pcgHash(seed + pcgHash(dimension >> 1));
+    uint32_t index = nestedUniformScramble(sample, pairSeed);
+    uint32_t value = (dimension & 1) ? sobolSecondDimension(index) : reverseBits(index);
+    return toFloat(nestedUniformScramble(value, pcgHash(pairSeed + (dimension & 1))));
+}
+
+float Sampler::getHalton(uint32_t sample, uint32_t dimension, uint32_t seed) {
+    static const std::vector<uint32_t> primes = []() {
+        std::vector<uint32_t> primes;
+        for (uint32_t n = 2; primes.size() < HALTON_BASES; ++n) {
+            bool isPrime = true;
+            for (uint32_t p: primes)
+                if (n % p == 0) {
+                    isPrime = false;
+                    break;
+                }
+            if (isPrime)
+                primes.push_back(n);
+        }
+        return primes;
+    }();
+
+    // radical inverse of the sample index in the base of the dimension, every digit goes through a random
+    // linear permutation chosen by the digits before it, otherwise the first samples of a large base
+    // would all fall into [0, 1 / base) and only become uniform after base samples
+    uint32_t base = primes[dimension];
+    double inverse = 1.0 / base, factor = inverse, value = 0.0;
+    for (uint32_t prefix = seed; factor > 0x1p-24; sample /= base, factor *= inverse) {
+        uint32_t digit = sample % base;
+        uint32_t hash = pcgHash(prefix);
+        value += (digit * (1 + hash % (base - 1)) + (hash >> 16)) % base * factor;
+        prefix = pcgHash(prefix + digit + 1);
+    }
+    return std::min(float(value), 0x1.fffffep-1f);
+}
+
+const float *Sampler::getBlueNoiseMask() {
+    // void-and-cluster on a torus, the rank of every pixel becomes its threshold
+    static const std::vector<float> mask = []() {
+        const int size = MASK_SIZE * MASK_SIZE;
+        const float sigma = 1.5f;
+        std::vector<float> kernel(size);
+        for (int dy = 0; dy < MASK_SIZE; ++dy) {
+            for (int dx = 0; dx < MASK_SIZE; ++dx) {
+                int wx = std::min(dx, MASK_SIZE - dx), wy = std::min(dy, MASK_SIZE - dy);
+                kernel[dy * MASK_SIZE + dx] = std::exp(-(wx * wx + wy * wy) / (2.0f * sigma * sigma));
+            }
+        }
+
+        std::vector<uint8_t> pattern(size, 0);
+        std::vector<float> energy(size, 0.0f);
+        auto toggle = [&](int p, float sign) {
+            pattern[p] = sign > 0;
+            int px = p & (MASK_SIZE - 1), py = p >> MASK_BITS;
+            for (int q = 0; q < size; ++q) {
+                int dx = ((q & (MASK_SIZE - 1)) - px) & (MASK_SIZE - 1), dy = ((q >> MASK_BITS) - py) & (MASK_SIZE - 1);
+                energy[q] += sign * kernel[dy * MASK_SIZE + dx];
+            }
+        };
+        // tightest cluster is the set pixel with the highest energy, largest void the empty one with the lowest
+        auto find = [&](uint8_t value, bool isHighest) {
+            int best = -1;
+            for (int p = 0; p < size; ++p)
+                if (pattern[p] == value && (best < 0 || (isHighest ? energy[p] > energy[best] : energy[p] < energy[best])))
+                    best = p;
+            return best;
+        };
+
+        // initial binary pattern, a tenth of the pixels spread by moving clusters into voids until it is stable
+        int ones = 0;
+        for (uint32_t k = 0; ones < size / 10; ++k) {
+            int p = pcgHash(k + RANDOM_SEED) % size;
+            if (!pattern[p])
+                toggle(p, 1.0f), ++ones;
+        }
+        for (int iteration = 0; iteration < size; ++iteration) {
+            int cluster = find(1, true);
+            toggle(cluster, -1.0f);
+            int hole = find(0, false);
+            toggle(hole, 1.0f);
+            if (hole == cluster)
+                break;
+        }
+        std::vector<uint8_t> initialPattern = pattern;
+        std::vector<float> initialEnergy = energy;
+
+        std::vector<int> rank(size);
+        // ranks below the initial pattern, remove clusters
+        for (int count = ones; count > 0; --count) {
+            int cluster = find(1, true);
+            toggle(cluster, -1.0f);
+            rank[cluster] = count - 1;
+        }
+        // ranks above it, fill voids
+        pattern = initialPattern;
+        energy = initialEnergy;
+        for (int count = ones; count < size; ++count) {
+            int hole = find(0, false);
+            toggle(hole, 1.0f);
+            rank[hole] = count;
+        }
+
+        std::vector<float> mask(size);
+        for (int p = 0; p < size; ++p)
+            mask[p] = (rank[p] + 0.5f) / size;
+        return mask;
+    }();
+    return mask.data();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+/*
+Sampler implementation
+CORE:
+- independent random, scrambled Sobol, Halton and blue noise sample sequences
+- every value is a pure function of (pixel, sample index, dimension) like the counter-based random numbers,
+  so images stay bit-identical regardless of thread count or tiling
+
+NOTE:
+- Sobol pads 2D (0,2)-sequences: dimensions 2k and 2k+1 form a pair which is Owen scrambled
+  and whose sample order is shuffled per pixel and pair (hash-based nested uniform scrambling)
+- Halton uses the first 128 prime bases with the digits scrambled per pixel, later dimensions fall back to random
+- blue noise rotates one scrambled Sobol sequence shared by all pixels by a void-and-cluster mask,
+  so neighbouring pixels get far apart offsets and the remaining error is pushed to high frequencies
+*/
+class Sampler {
+public:
+    enum class Type { RANDOM, SOBOL, HALTON, BLUE_NOISE };
+
+private:
+    static Type type;
+
+public:
+    static bool parseType(const std::string &name, Type &type);
+    static const char *getTypeName(Type type);
+    static void setType(Type _type);
+    static Type getType() { return type; }
+
+    // sample in [0.0, 1.0) of the given dimension
+    static float get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension);
+
+private:
+    static float getSobol(uint32_t sample, uint32_t dimension, uint32_t seed);
+    static float getHalton(uint32_t sample, uint32_t dimension, uint32_t seed);
+    static const float *getBlueNoiseMask();
+};
@@ -3,13 +3,64 @@
 
 void Scene::buildBVH() {
     if (!IS_SAH)
-        bvh = new BVH(objects, BVH::SplitMethod::NAIVE);
+        bvh.reset(new BVH(objects, BVH::SplitMethod::NAIVE));
     else
-        bvh = new BVH(objects, BVH::SplitMethod::SAH);
+        bvh.reset(new BVH(objects, BVH::SplitMethod::SAH));
 }
 
+void VirtualPointLights::push(const Vector3f &position, const Vector3f &normal, const Vector3f &power) {
+    positionX.push_back(position.x); positionY.push_back(position.y); positionZ.push_back(position.z);
+    normalX.push_back(normal.x); normalY.push_back(normal.y); normalZ.push_back(normal.z);
+    powerR.push_back(power.x); powerG.push_back(power.y); powerB.push_back(power.z);
+}
+
+void Scene::buildVPLs() {
+    // the points of one emitter are consecutive samples of its own sequence, so low-discrepancy samplers
+    // stratify them over the emitter and every set fills the gaps left by the previous ones
+    vpls = VirtualPointLights();
+    vplSetSize = 0;
+    for (int set = 0; set < AREA2POINT_SETS; ++set) {
+        for (size_t k = 0; k < objects.size(); ++k) {
+            Object *object = objects[k];
+            if (object->material->getType() != EMISSION)
+                continue;
+            for (int i = 0; i < AREA2POINT_NUM; ++i) {
+                Intersection lightSample;
+                float lightPdf = 0.0;
+                seedRandom(k, 0, set * AREA2POINT_NUM + i);
+                startRandomDimension(0, DIMENSION_LIGHT);
+                object->sample(lightSample, lightPdf);
+                vpls.push(lightSample.coordinate, lightSample.normal,
+                          object->material->intensity * object->getArea() / AREA2POINT_NUM);
+            }
+        }
+    }
+    vplSetSize = vpls.size() / AREA2POINT_SETS;
+}
+
+std::unique_ptr<Scene> Scene::replicate() const {
+    std::unique_ptr<Scene> replica(new Scene());
+    for (Object *object: objects) {
+        replica->ownedObjects.emplace_back(object->clone());
+        replica->add(replica->ownedObjects.back().get());
+    }
+    for (Light *light: lights) {
+        replica->ownedLights.emplace_back(new Light(*light));
+        replica->add(replica->ownedLights.back().get());
+    }
+    if (bvh != nullptr)
+        replica->buildBVH();
+    replica->backgroundColor = backgroundColor;
+    replica->ambientIntensity = ambientIntensity;
+    replica->maxDepth = maxDepth;
+    replica->vpls = vpls;
+    replica->vplSetSize = vplSetSize;
+    return replica;
+}
+
+template <bool isBVH>
 Intersection Scene::intersect(const Ray &ray) const {
-    if (!IS_BVH) {
+    if constexpr (!isBVH) {
         Intersection intersection;
         float tNear = kInfinity;
         for (const auto &object: objects) {
@@ -26,255 +77,345 @@ Intersection Scene::intersect(const Ray &ray) const {
     }
 }
 
-Vector3f Scene::castRay(const Ray &ray, int depth) const {
-    if (IS_PATH) {
-        // path tracing
-        if (depth > MAX_DEPTH)
-            return Vector3f(0.0, 0.0, 0.0);
-        
-        Vector3f hitColor = backgroundColor;
-        Intersection intersection = intersect(ray);
-        Material *material = intersection.material;
-        Object *hitObject = intersection.object;
-        if (intersection.happened) {
-            Vector3f hitCoordinate = intersection.coordinate;
-            Vector3f hitNormal = intersection.normal;
-            switch (material->getType()) {
-                case DIFFUSE:
-                {
-                    Vector3f LDir = {0.0, 0.0, 0.0};
-                    Vector3f LIndir = {0.0, 0.0, 0.0};
+template Intersection Scene::intersect<false>(const Ray &ray) const;
+template Intersection Scene::intersect<true>(const Ray &ray) const;
 
-                    Vector3f hitPointOrig = (dotProduct(ray.direction, hitNormal) < 0) ?
-                                            hitCoordinate + hitNormal * epsilon2 :
-                                            hitCoordinate - hitNormal * epsilon2;
+Intersection Scene::intersect(const Ray &ray) const {
+    return (bvh != nullptr) ? intersect<true>(ray) : intersect<false>(ray);
+}
 
-                    // sample on light
-                    bool isPointLight = getRandomFloat() <= POINT_LIGHT_RATIO;
-                    if (isPointLight && lights.size() > 0) {
-                        // point light
-                        int lightIndex = getRandomInt(0, lights.size() - 1);
-                        auto &light = lights[lightIndex];
-                        Vector3f lightPosition = light->position;
-                        Vector3f lightIntensity = light->intensity;
-                        Vector3f lightDir = lightPosition - hitPointOrig;
-                        float lightDistance2 = dotProduct(lightDir, lightDir);
-                        lightDir = normalize(lightDir);
-                        Intersection intersection2 = intersect(Ray(hitPointOrig, lightDir));
-                        bool isDir = (!intersection2.happened) || (intersection2.happened && intersection2.distance >= std::sqrt(lightDistance2) - epsilon2);
-                        if (isDir) {
-                            LDir = lightIntensity * material->brdf(ray.direction, lightDir, hitNormal) 
-                                    * dotProduct(lightDir, hitNormal) / lightDistance2;
-                        }
-                    } else {
-                        // area light
-                        Intersection lightSample;
-                        float lightPdf = 0.0;
-                        sampleLight(lightSample, lightPdf);
-                        Vector3f lightPosition = lightSample.coordinate;
-                        Vector3f lightNormal = lightSample.normal;
-                        Vector3f lightIntensity = lightSample.material->intensity;
-                        // shoot a ray from hit point to light
-                        Vector3f lightDir = lightPosition - hitPointOrig;
-                        float lightDistance2 = dotProduct(lightDir, lightDir);
-                        lightDir = normalize(lightDir);
-                        // direct illumination
-                        Intersection intersection2 = intersect(Ray(hitPointOrig, lightDir));
-                        bool isDir = (!intersection2.happened) || (intersection2.happened && intersection2.distance >= std::sqrt(lightDistance2) - epsilon2);
-                        if (isDir) {
-                            LDir = lightIntensity * material->brdf(ray.direction, lightDir, hitNormal) 
-                                    * dotProduct(lightDir, hitNormal) * dotProduct(-lightDir, lightNormal) 
-                                    / lightDistance2 / lightPdf;
-                        }
-                    }
-                    
-                    // russian roulette
-                    bool isIndir = getRandomFloat() <= PATH_RR;
-                    if (isIndir) {
-                        // sample on hemisphere
-                        Vector3f wi = material->sample(ray.direction, hitNormal).normalized();
-                        // shoot a ray from hit point to wi direction
-                        Ray rayIndir(hitPointOrig, wi);
-                        Intersection interIndir = intersect(rayIndir);
-                        if (interIndir.happened && interIndir.material->getType() != EMISSION) {
-                            LIndir = castRay(rayIndir, depth + 1) * material->brdf(ray.direction, wi, hitNormal) 
-                                        * dotProduct(wi, hitNormal) / material->pdf(ray.direction, wi, hitNormal) / PATH_RR;
-                        }
-                    }
-                    hitColor = LDir + LIndir;
-                } break;
-                case REFLECTION:
-                {
-                    Vector3f reflectionDirection = normalize(reflect(ray.direction, hitNormal));
-                    Vector3f reflectionRayOrig = (dotProduct(reflectionDirection, hitNormal) < 0) ?
-                                                hitCoordinate - hitNormal * epsilon2 :
-                                                hitCoordinate + hitNormal * epsilon2;
-                    hitColor = castRay(Ray(reflectionRayOrig, reflectionDirection), depth + 1);
-                } break;
-                case REFRACTION:
-                {
-                    Vector3f refractionDirection = normalize(refract(ray.direction, hitNormal, material->ior));
-                    Vector3f refractionRayOrig = (dotProduct(refractionDirection, hitNormal) < 0) ?
-                                                hitCoordinate - hitNormal * epsilon2 :
-                                                hitCoordinate + hitNormal * epsilon2;
-                    hitColor = castRay(Ray(refractionRayOrig, refractionDirection), depth + 1);
-                } break;
-                case REFLECTION_AND_REFRACTION:
-                {
-                    Vector3f reflectionDirection = normalize(reflect(ray.direction, hitNormal));
-                    Vector3f refractionDirection = normalize(refract(ray.direction, hitNormal, material->ior));
-                    Vector3f reflectionRayOrig = (dotProduct(reflectionDirection, hitNormal) < 0) ?
-                                                hitCoordinate - hitNormal * epsilon2 :
-                                                hitCoordinate + hitNormal * epsilon2;
-                    Vector3f refractionRayOrig = (dotProduct(refractionDirection, hitNormal) < 0) ?
-                                                hitCoordinate - hitNormal * epsilon2 :
-                                                hitCoordinate + hitNormal * epsilon2;
-                    Vector3f reflectionColor = castRay(Ray(reflectionRayOrig, reflectionDirection), depth + 1);
-                    Vector3f refractionColor = castRay(Ray(refractionRayOrig, refractionDirection), depth + 1);
-                    float kr = fresnel(ray.direction, hitNormal, material->ior);
-                    hitColor = reflectionColor * kr + refractionColor * (1 - kr);
-                } break;
-                case EMISSION:
-                {
-                    hitColor = material->intensity;
-                } break;
-                default:
-                {
-                    throw std::runtime_error("Unsupported material type.");
+Scene::Tracer Scene::getTracer(bool isPath) const {
+    if (bvh != nullptr)
+        return {&Scene::intersect<true>, isPath ? &Scene::trace<true, true> : &Scene::trace<false, true>};
+    return {&Scene::intersect<false>, isPath ? &Scene::trace<true, false> : &Scene::trace<false, false>};
+}
+
+template <bool isPath, bool isBVH>
+Vector3f Scene::trace(const Ray &ray, const Intersection &intersection, RadianceSplit *split) const {
+    if constexpr (isPath)
+        return tracePath<isBVH>(ray, intersection, 0, split);
+    else
+        return castRay<isBVH>(ray, intersection, 0, split, 1.0f);
+}
+
+template <bool isBVH>
+Vector3f Scene::castRay(const Ray &ray, int depth, float weight) const {
+    if (depth > maxDepth)
+        return Vector3f(0.0, 0.0, 0.0);
+    return castRay<isBVH>(ray, intersect<isBVH>(ray), depth, nullptr, weight);
+}
+
+template <bool isBVH>
+Vector3f Scene::castRay(const Ray &ray, const Intersection &intersection, int depth, RadianceSplit *split, float weight) const {
+    if (depth > maxDepth)
+        return Vector3f(0.0, 0.0, 0.0);
+
+    Vector3f hitColor = backgroundColor;
+    Material *material = intersection.material;
+    Object *hitObject = intersection.object;
+    if (intersection.happened) {
+        Vector3f hitCoordinate = intersection.coordinate;
+        Vector3f hitNormal = intersection.normal;
+        switch (material->getType()) {
+            case DIFFUSE:
+            {
+                // Blinn-Phong model
+                Vector3f ambientColor = 0, diffuseColor = 0, specularColor = 0;
+                bool outside = dotProduct(ray.direction, hitNormal) < 0;
+                Vector3f shadowPointOrig = outside ?
+                                        hitCoordinate + hitNormal * epsilon2 :
+                                        hitCoordinate - hitNormal * epsilon2;
+                // ambient
+                ambientColor += outside ? 0 : ambientIntensity;
+                // point light
+                for (auto &light: lights) {
+                    Vector3f lightDir = light->position - shadowPointOrig;
+                    float lightDistance2 = dotProduct(lightDir, lightDir);
+                    lightDir = normalize(lightDir);
+                    float LdotN = std::max(0.f, dotProduct(lightDir, hitNormal));
+                    // hard shadow
+                    Intersection intersection2 = intersect<isBVH>(Ray(shadowPointOrig, lightDir));
+                    bool inShadow = intersection2.happened && (intersection2.distance < std::sqrt(lightDistance2) - epsilon2);
+                    // diffuse
+                    diffuseColor += inShadow ? 0 : light->intensity * LdotN / lightDistance2;
+                    // specular
+                    Vector3f halfVector = normalize(lightDir - ray.direction);
+                    specularColor += inShadow ? 0 : light->intensity / lightDistance2 * 
+                        powf(std::max(0.f, dotProduct(hitNormal, halfVector)), material->specularExponent);
+                }
+                // area light, one set of virtual point lights stands in for all emitting objects
+                size_t vplBegin = (getRandomState().sample % AREA2POINT_SETS) * vplSetSize;
+                for (size_t k = vplBegin; k < vplBegin + vplSetSize; ++k) {
+                    // similar to point light
+                    Vector3f lightDir = Vector3f(vpls.positionX[k], vpls.positionY[k], vpls.positionZ[k]) - shadowPointOrig;
+                    float lightDistance2 = dotProduct(lightDir, lightDir);
+                    lightDir = normalize(lightDir);
+                    // emitting objects only light their front side, no shadow ray behind them
+                    if (lightDir.x * vpls.normalX[k] + lightDir.y * vpls.normalY[k] + lightDir.z * vpls.normalZ[k] >= 0)
+                        continue;
+                    float LdotN = std::max(0.f, dotProduct(lightDir, hitNormal));
+                    // hard shadow
+                    Intersection intersection2 = intersect<isBVH>(Ray(shadowPointOrig, lightDir));
+                    bool inShadow = intersection2.happened && (intersection2.distance < std::sqrt(lightDistance2) - epsilon2);
+                    if (inShadow)
+                        continue;
+                    Vector3f power(vpls.powerR[k], vpls.powerG[k], vpls.powerB[k]);
+                    // diffuse
+                    diffuseColor += power * LdotN / lightDistance2;
+                    // specular
+                    Vector3f halfVector = normalize(lightDir - ray.direction);
+                    specularColor += power / lightDistance2 *
+                        powf(std::max(0.f, dotProduct(hitNormal, halfVector)), material->specularExponent);
                 }
+
+                hitColor = material->Ka * ambientColor + material->Kd * diffuseColor + material->Ks * specularColor;
+            } break;
+            case REFLECTION:
+            {
+                Vector3f reflectionDirection = normalize(reflect(ray.direction, hitNormal));
+                Vector3f reflectionRayOrig = (dotProduct(reflectionDirection, hitNormal) < 0) ?
+                                            hitCoordinate - hitNormal * epsilon2 :
+                                            hitCoordinate + hitNormal * epsilon2;
+                // a perfect mirror passes on all of the radiance, so the branch keeps its weight and is only
+                // pruned below a Fresnel split, two facing mirrors are bounded by the maximum depth alone
+                hitColor = castRay<isBVH>(Ray(reflectionRayOrig, reflectionDirection), depth + 1, weight);
+            } break;
+            case REFRACTION:
+            {
+                Vector3f refractionDirection = normalize(refract(ray.direction, hitNormal, material->ior));
+                Vector3f refractionRayOrig = (dotProduct(refractionDirection, hitNormal) < 0) ?
+                                            hitCoordinate - hitNormal * epsilon2 :
+                                            hitCoordinate + hitNormal * epsilon2;
+                // lossless like the mirror above, the weight passes through unchanged
+                hitColor = castRay<isBVH>(Ray(refractionRayOrig, refractionDirection), depth + 1, weight);
+            } break;
+            case REFLECTION_AND_REFRACTION:
+            {
+                Vector3f reflectionDirection = normalize(reflect(ray.direction, hitNormal));
+                Vector3f refractionDirection = normalize(refract(ray.direction, hitNormal, material->ior));
+                Vector3f reflectionRayOrig = (dotProduct(reflectionDirection, hitNormal) < 0) ?
+                                            hitCoordinate - hitNormal * epsilon2 :
+                                            hitCoordinate + hitNormal * epsilon2;
+                Vector3f refractionRayOrig = (dotProduct(refractionDirection, hitNormal) < 0) ?
+                                            hitCoordinate - hitNormal * epsilon2 :
+                                            hitCoordinate + hitNormal * epsilon2;
+                // each branch carries its Fresnel share of the weight, branches below WHITTED_MIN_WEIGHT
+                // are dropped and so is the refraction under total internal reflection where kr is 1
+                float kr = fresnel(ray.direction, hitNormal, material->ior);
+                float reflectionWeight = weight * kr, refractionWeight = weight * (1 - kr);
+                Vector3f reflectionColor = (reflectionWeight > WHITTED_MIN_WEIGHT) ?
+                    castRay<isBVH>(Ray(reflectionRayOrig, reflectionDirection), depth + 1, reflectionWeight) : Vector3f(0.0f);
+                Vector3f refractionColor = (refractionWeight > WHITTED_MIN_WEIGHT) ?
+                    castRay<isBVH>(Ray(refractionRayOrig, refractionDirection), depth + 1, refractionWeight) : Vector3f(0.0f);
+                hitColor = reflectionColor * kr + refractionColor * (1 - kr);
+            } break;
+            case EMISSION:
+            {
+                hitColor = material->intensity;
+            } break;
+            default:
+            {
+                throw std::runtime_error("Unsupported material type.");
             }
         }
-        return hitColor;
-    } else {
-        // Whitted-style ray tracing
-        if (depth > MAX_DEPTH)
-            return Vector3f(0.0, 0.0, 0.0);
+    }
+    // there are no separate light paths to tell apart, everything is direct
+    if (split != nullptr)
+        split->direct += hitColor;
+    return hitColor;
+}
+
+template <bool isBVH>
+Vector3f Scene::tracePath(const Ray &cameraRay, const Intersection &cameraHit, int depth, RadianceSplit *split) const {
+    // iterative path tracing, the hit of every ray is reused by the next bounce so each ray is traced once
+    Ray ray = cameraRay;
+    Intersection intersection = cameraHit;
+    Vector3f radiance(0.0f);
+    Vector3f throughput(1.0f);
+    // only needed by AOVs, lighting counts as direct until the first diffuse bounce
+    bool isDirect = true;
+    // only needed by AOVs, contribution is already weighted by the throughput, group -1 is the background
+    auto record = [&](int group, const Vector3f &contribution) {
+        if (split == nullptr)
+            return;
+        (isDirect ? split->direct : split->indirect) += contribution;
+        if (group >= 0)
+            split->groups[group] += contribution;
+    };
+    for (; depth <= maxDepth; ++depth) {
+        if (!intersection.happened) {
+            // only camera and specular rays reach here, indirect rays which miss are terminated
+            radiance += throughput * backgroundColor;
+            record(-1, throughput * backgroundColor);
+            break;
+        }
 
-        Vector3f hitColor = backgroundColor;
-        Intersection intersection = intersect(ray);
         Material *material = intersection.material;
-        Object *hitObject = intersection.object;
-        if (intersection.happened) {
-            Vector3f hitCoordinate = intersection.coordinate;
-            Vector3f hitNormal = intersection.normal;
-            switch (material->getType()) {
-                case DIFFUSE:
-                {
-                    // Blinn-Phong model
-                    Vector3f ambientColor = 0, diffuseColor = 0, specularColor = 0;
-                    bool outside = dotProduct(ray.direction, hitNormal) < 0;
-                    Vector3f shadowPointOrig = outside ?
-                                            hitCoordinate + hitNormal * epsilon2 :
-                                            hitCoordinate - hitNormal * epsilon2;
-                    // ambient
-                    ambientColor += outside ? 0 : ambientIntensity;
+        const Vector3f &hitCoordinate = intersection.coordinate;
+        const Vector3f &hitNormal = intersection.normal;
+        switch (material->getType()) {
+            case DIFFUSE:
+            {
+                Vector3f LDir = {0.0, 0.0, 0.0};
+
+                Vector3f hitPointOrig = (dotProduct(ray.direction, hitNormal) < 0) ?
+                                        hitCoordinate + hitNormal * epsilon2 :
+                                        hitCoordinate - hitNormal * epsilon2;
+
+                // sample on light
+                int lightGroup = -1;
+                startRandomDimension(depth, DIMENSION_LIGHT);
+                bool isPointLight = getRandomFloat() <= POINT_LIGHT_RATIO;
+                if (isPointLight && lights.size() > 0) {
                     // point light
-                    for (auto &light: lights) {
-                        Vector3f lightDir = light->position - shadowPointOrig;
-                        float lightDistance2 = dotProduct(lightDir, lightDir);
-                        lightDir = normalize(lightDir);
-                        float LdotN = std::max(0.f, dotProduct(lightDir, hitNormal));
-                        // hard shadow
-                        Intersection intersection2 = intersect(Ray(shadowPointOrig, lightDir));
-                        bool inShadow = intersection2.happened && (intersection2.distance < std::sqrt(lightDistance2) - epsilon2);
-                        // diffuse
-                        diffuseColor += inShadow ? 0 : light->intensity * LdotN / lightDistance2;
-                        // specular
-                        Vector3f halfVector = normalize(lightDir - ray.direction);
-                        specularColor += inShadow ? 0 : light->intensity / lightDistance2 * 
-                            powf(std::max(0.f, dotProduct(hitNormal, halfVector)), material->specularExponent);
+                    int lightIndex = getRandomInt(0, lights.size() - 1);
+                    auto &light = lights[lightIndex];
+                    lightGroup = emissionCount + lightIndex;
+                    Vector3f lightDir = light->position - hitPointOrig;
+                    float lightDistance2 = dotProduct(lightDir, lightDir);
+                    lightDir = normalize(lightDir);
+                    Intersection intersection2 = intersect<isBVH>(Ray(hitPointOrig, lightDir));
+                    bool isDir = (!intersection2.happened) || (intersection2.happened && intersection2.distance >= std::sqrt(lightDistance2) - epsilon2);
+                    if (isDir) {
+                        LDir = light->intensity * material->brdf(ray.direction, lightDir, hitNormal) 
+                                * dotProduct(lightDir, hitNormal) / lightDistance2;
                     }
+                } else {
                     // area light
-                    for (auto &object: objects) {
-                        if (object->material->getType() == EMISSION) {
-                            for (int i = 0; i < AREA2POINT_NUM; ++i) {
-                                // sample on area light
-                                Intersection lightSample;
-                                float lightPdf = 0.0;
-                                object->sample(lightSample, lightPdf);
-                                // similar to point light
-                                Vector3f lightDir = lightSample.coordinate - shadowPointOrig;
-                                float lightDistance2 = dotProduct(lightDir, lightDir);
-                                lightDir = normalize(lightDir);
-                                float LdotN = std::max(0.f, dotProduct(lightDir, hitNormal));
-                                // hard shadow
-                                Intersection intersection2 = intersect(Ray(shadowPointOrig, lightDir));
-                                bool inShadow = intersection2.happened && (intersection2.distance < std::sqrt(lightDistance2) - epsilon2);
-                                // diffuse
-                                diffuseColor += inShadow ? 0 : object->material->intensity * object->getArea() / AREA2POINT_NUM * LdotN / lightDistance2;
-                                // specular
-                                Vector3f halfVector = normalize(lightDir - ray.direction);
-                                specularColor += inShadow ? 0 : object->material->intensity * object->getArea() / AREA2POINT_NUM / lightDistance2 * 
-                                    powf(std::max(0.f, dotProduct(hitNormal, halfVector)), material->specularExponent);
-                            }
+                    Intersection lightSample;
+                    float lightPdf = 0.0;
+                    if (sampleLight(lightSample, lightPdf)) {
+                        lightGroup = objectLightGroups[lightSample.object->id];
+                        // shoot a ray from hit point to light
+                        Vector3f lightDir = lightSample.coordinate - hitPointOrig;
+                        float lightDistance2 = dotProduct(lightDir, lightDir);
+                        lightDir = normalize(lightDir);
+                        float cosLight = dotProduct(-lightDir, lightSample.normal);
+                        // direct illumination
+                        Intersection intersection2 = intersect<isBVH>(Ray(hitPointOrig, lightDir));
+                        bool isDir = (!intersection2.happened) || (intersection2.happened && intersection2.distance >= std::sqrt(lightDistance2) - epsilon2);
+                        if (isDir && cosLight > 0) {
+                            // multiple importance sampling with the BSDF sample hitting the light below,
+                            // the last vertex takes no BSDF sample so the light sample keeps its full weight
+                            float weight = (depth + 1 > maxDepth) ? 1.0f :
+                                           powerHeuristic(getAreaLightShare() * lightPdf * lightDistance2 / cosLight,
+                                                          material->pdf(ray.direction, lightDir, hitNormal));
+                            LDir = lightSample.material->intensity * material->brdf(ray.direction, lightDir, hitNormal) 
+                                    * dotProduct(lightDir, hitNormal) * cosLight 
+                                    / lightDistance2 / lightPdf * weight;
                         }
                     }
+                }
+                radiance += throughput * LDir;
+                record(lightGroup, throughput * LDir);
+
+                // russian roulette, paths carrying little energy are more likely to stop
+                float survival = std::min<float>(PATH_RR, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+                startRandomDimension(depth, DIMENSION_RR);
+                if (getRandomFloat() >= survival || depth + 1 > maxDepth)
+                    return radiance;
 
-                    hitColor = material->Ka * ambientColor + material->Kd * diffuseColor + material->Ks * specularColor;
-                } break;
-                case REFLECTION:
-                {
-                    Vector3f reflectionDirection = normalize(reflect(ray.direction, hitNormal));
-                    Vector3f reflectionRayOrig = (dotProduct(reflectionDirection, hitNormal) < 0) ?
-                                                hitCoordinate - hitNormal * epsilon2 :
-                                                hitCoordinate + hitNormal * epsilon2;
-                    hitColor = castRay(Ray(reflectionRayOrig, reflectionDirection), depth + 1);
-                } break;
-                case REFRACTION:
-                {
-                    Vector3f refractionDirection = normalize(refract(ray.direction, hitNormal, material->ior));
-                    Vector3f refractionRayOrig = (dotProduct(refractionDirection, hitNormal) < 0) ?
-                                                hitCoordinate - hitNormal * epsilon2 :
-                                                hitCoordinate + hitNormal * epsilon2;
-                    hitColor = castRay(Ray(refractionRayOrig, refractionDirection), depth + 1);
-                } break;
-                case REFLECTION_AND_REFRACTION:
-                {
-                    Vector3f reflectionDirection = normalize(reflect(ray.direction, hitNormal));
-                    Vector3f refractionDirection = normalize(refract(ray.direction, hitNormal, material->ior));
-                    Vector3f reflectionRayOrig = (dotProduct(reflectionDirection, hitNormal) < 0) ?
-                                                hitCoordinate - hitNormal * epsilon2 :
-                                                hitCoordinate + hitNormal * epsilon2;
-                    Vector3f refractionRayOrig = (dotProduct(refractionDirection, hitNormal) < 0) ?
-                                                hitCoordinate - hitNormal * epsilon2 :
-                                                hitCoordinate + hitNormal * epsilon2;
-                    Vector3f reflectionColor = castRay(Ray(reflectionRayOrig, reflectionDirection), depth + 1);
-                    Vector3f refractionColor = castRay(Ray(refractionRayOrig, refractionDirection), depth + 1);
-                    float kr = fresnel(ray.direction, hitNormal, material->ior);
-                    hitColor = reflectionColor * kr + refractionColor * (1 - kr);
-                } break;
-                case EMISSION:
-                {
-                    hitColor = material->intensity;
-                } break;
-                default:
-                {
-                    throw std::runtime_error("Unsupported material type.");
+                // sample on hemisphere
+                startRandomDimension(depth, DIMENSION_BSDF);
+                BSDFSample bsdf;
+                if (!material->sample(ray.direction, hitNormal, bsdf))
+                    return radiance;
+                const Vector3f &wi = bsdf.direction;
+                Ray rayIndir(hitPointOrig, wi);
+                Intersection interIndir = intersect<isBVH>(rayIndir);
+                if (!interIndir.happened)
+                    return radiance;
+                float bsdfPdf = bsdf.pdf;
+                throughput = throughput * bsdf.f * dotProduct(wi, hitNormal) / bsdfPdf / survival;
+                if (interIndir.material->getType() == EMISSION) {
+                    // the BSDF sample found the light, weighted against sampling on light above
+                    float cosLight = dotProduct(-wi, interIndir.normal);
+                    if (cosLight > 0) {
+                        float lightPdf = getAreaLightShare() * getLightPdf() * interIndir.distance * interIndir.distance / cosLight;
+                        Vector3f LIndir = throughput * interIndir.material->intensity
+                                          * getAreaLightShare() * powerHeuristic(bsdfPdf, lightPdf);
+                        radiance += LIndir;
+                        record(objectLightGroups[interIndir.object->id], LIndir);
+                    }
+                    return radiance;
                 }
+                isDirect = false;
+                ray = rayIndir;
+                intersection = interIndir;
+            } break;
+            case REFLECTION:
+            {
+                Vector3f reflectionDirection = normalize(reflect(ray.direction, hitNormal));
+                Vector3f reflectionRayOrig = (dotProduct(reflectionDirection, hitNormal) < 0) ?
+                                            hitCoordinate - hitNormal * epsilon2 :
+                                            hitCoordinate + hitNormal * epsilon2;
+                ray = Ray(reflectionRayOrig, reflectionDirection);
+                intersection = intersect<isBVH>(ray);
+            } break;
+            case REFRACTION:
+            {
+                Vector3f refractionDirection = normalize(refract(ray.direction, hitNormal, material->ior));
+                Vector3f refractionRayOrig = (dotProduct(refractionDirection, hitNormal) < 0) ?
+                                            hitCoordinate - hitNormal * epsilon2 :
+                                            hitCoordinate + hitNormal * epsilon2;
+                ray = Ray(refractionRayOrig, refractionDirection);
+                intersection = intersect<isBVH>(ray);
+            } break;
+            case REFLECTION_AND_REFRACTION:
+            {
+                // one branch chosen with its Fresnel weight as probability, the weight cancels
+                // and the path stays one ray per bounce instead of a tree
+                float kr = fresnel(ray.direction, hitNormal, material->ior);
+                startRandomDimension(depth, DIMENSION_FRESNEL);
+                Vector3f direction = (getRandomFloat() < kr) ?
+                                     normalize(reflect(ray.direction, hitNormal)) :
+                                     normalize(refract(ray.direction, hitNormal, material->ior));
+                Vector3f rayOrig = (dotProduct(direction, hitNormal) < 0) ?
+                                   hitCoordinate - hitNormal * epsilon2 :
+                                   hitCoordinate + hitNormal * epsilon2;
+                ray = Ray(rayOrig, direction);
+                intersection = intersect<isBVH>(ray);
+            } break;
+            case EMISSION:
+            {
+                radiance += throughput * material->intensity;
+                record(objectLightGroups[intersection.object->id], throughput * material->intensity);
+                return radiance;
+            } break;
+            default:
+            {
+                throw std::runtime_error("Unsupported material type.");
             }
         }
-        return hitColor;
     }
-    // never reach here actually
-    return Vector3f(0, 0, 0);
+    return radiance;
+}
+
+std::vector<std::string> Scene::getLightGroups() const {
+    std::vector<std::string> groups;
+    for (Object *object: objects)
+        if (object->material->getType() == EMISSION)
+            groups.push_back(object->name);
+    for (uint32_t k = 0; k < lights.size(); ++k)
+        groups.push_back("pointlight" + std::to_string(k));
+    return groups;
 }
 
-void Scene::sampleLight(Intersection &position, float &pdf) const {
+bool Scene::sampleLight(Intersection &position, float &pdf) const {
+    if (emissionArea <= 0)
+        return false;
+    float p = getRandomFloat() * emissionArea;
     float emissionAreaSum = 0;
-    for (uint32_t k = 0; k < objects.size(); ++k) {
-        if (objects[k]->material->getType() == EMISSION){
-            emissionAreaSum += objects[k]->getArea();
-        }
-    }
-    float p = getRandomFloat() * emissionAreaSum;
-    emissionAreaSum = 0;
     for (uint32_t k = 0; k < objects.size(); ++k) {
         if (objects[k]->material->getType() == EMISSION) {
             emissionAreaSum += objects[k]->getArea();
             if (p <= emissionAreaSum) {
+                // the object is chosen by its share of the emitting area
                 objects[k]->sample(position, pdf);
-                break;
+                pdf *= objects[k]->getArea() / emissionArea;
+                return pdf > 0;
             }
         }
     }
+    return false;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "vector.hpp"
@@ -11,36 +13,136 @@
 #include "intersection.hpp"
 
 
+// radiance of the samples split into direct and indirect lighting and by light group, only needed by AOVs
+struct RadianceSplit {
+    Vector3f direct, indirect;
+    std::vector<Vector3f> groups;       // indexed like Scene::getLightGroups
+};
+
+// only needed by Whitted-style ray tracing, point samples standing in for the emitting objects
+struct VirtualPointLights {
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> normalX, normalY, normalZ;
+    std::vector<float> powerR, powerG, powerB;      // intensity times the area each point stands for
+
+    size_t size() const { return positionX.size(); }
+    void push(const Vector3f &position, const Vector3f &normal, const Vector3f &power);
+};
+
 /*
 Scene implementation
 CORE: 
 - Ray Tracing (Whitted-style or Path Tracing)
+
+NOTE:
+- the integrators are specialized for the accelerator, getTracer picks the variant once
+  so neither the integrator nor the accelerator is tested per ray
 */
 class Scene {
+public:
+    // intersect and trace an already intersected camera ray with one integrator and accelerator
+    struct Tracer {
+        Intersection (Scene::*intersect)(const Ray &ray) const;
+        Vector3f (Scene::*trace)(const Ray &ray, const Intersection &intersection, RadianceSplit *split) const;
+    };
+
 private:
     Vector3f backgroundColor = Vector3f(BACKGROUND_R, BACKGROUND_G, BACKGROUND_B);
     Vector3f ambientIntensity = Vector3f(AMBIENT_R, AMBIENT_G, AMBIENT_B);
+    int maxDepth = MAX_DEPTH;
 
     std::vector<Object *> objects;
     std::vector<Light *> lights;
 
-    BVH *bvh;               // only needed by BVH acceleration
+    std::unique_ptr<BVH> bvh;   // only needed by BVH acceleration
+
+    // light group of every object, -1 if it does not emit, only needed by AOVs
+    std::vector<int> objectLightGroups;
+    int emissionCount;
+    float emissionArea;     // only needed by path tracing
+
+    // only needed by Whitted-style ray tracing, AREA2POINT_SETS sets of AREA2POINT_NUM points per emitting object
+    VirtualPointLights vpls;
+    size_t vplSetSize = 0;
+
+    // geometry owned by the scene itself (replicas and scenes built from a description),
+    // objects added by raw pointer belong to the caller
+    std::vector<std::unique_ptr<Object>> ownedObjects;
+    std::vector<std::unique_ptr<Light>> ownedLights;
+    std::vector<std::unique_ptr<Material>> ownedMaterials;
 
 public:
-    Scene(): bvh(nullptr) {}
+    Scene(): emissionCount(0), emissionArea(0) {}
 
-    void add(Object *object) { objects.push_back(object); }
+    void add(Object *object) {
+        object->setId(objects.size());
+        objects.push_back(object);
+        objectLightGroups.push_back(object->material->getType() == EMISSION ? emissionCount++ : -1);
+        if (object->material->getType() == EMISSION)
+            emissionArea += object->getArea();
+    }
     void add(Light *light) { lights.push_back(std::move(light)); }
+    void add(std::unique_ptr<Object> object) {
+        ownedObjects.push_back(std::move(object));
+        add(ownedObjects.back().get());
+    }
+    void add(std::unique_ptr<Light> light) {
+        ownedLights.push_back(std::move(light));
+        add(ownedLights.back().get());
+    }
+    Material *add(std::unique_ptr<Material> material) {
+        ownedMaterials.push_back(std::move(material));
+        return ownedMaterials.back().get();
+    }
+
+    void setBackground(const Vector3f &color) { backgroundColor = color; }
+    void setAmbient(const Vector3f &intensity) { ambientIntensity = intensity; }
+    void setMaxDepth(int depth) { maxDepth = depth; }
+    bool isBVH() const { return bvh != nullptr; }
 
     const std::vector<Object *> &getObjects() const { return objects; }
     const std::vector<Light *> &getLights() const { return lights; }
+    // emitting objects first, then point lights
+    std::vector<std::string> getLightGroups() const;
 
-    void buildBVH();        // only needed by BVH acceleration
+    void buildBVH();        // only needed by BVH acceleration, scenes without it are scanned linearly
+    // only needed by Whitted-style ray tracing, samples the emitting objects once for all pixels
+    void buildVPLs();
+    // deep copy of the objects and accelerators, the memory is allocated by the calling thread
+    std::unique_ptr<Scene> replicate() const;
     
-    Vector3f castRay(const Ray &ray, int depth) const;
+    // isPath selects path tracing or Whitted-style ray tracing, so one resident scene serves both,
+    // the radiance is also added to split if it is given
+    Tracer getTracer(bool isPath) const;
 
-private:
+    template <bool isBVH>
     Intersection intersect(const Ray &ray) const;
+    // for rays outside of the integrators, tests the accelerator every time
+    Intersection intersect(const Ray &ray) const;
+
+private:
+    template <bool isPath, bool isBVH>
+    Vector3f trace(const Ray &ray, const Intersection &intersection, RadianceSplit *split) const;
+    // only needed by Whitted-style ray tracing, weight is the share of the pixel the ray contributes to
+    // and prunes the ray tree
+    template <bool isBVH>
+    Vector3f castRay(const Ray &ray, int depth, float weight) const;
+    // same as above for a ray which is already intersected, e.g. the camera ray shared by all samples of a pixel
+    template <bool isBVH>
+    Vector3f castRay(const Ray &ray, const Intersection &intersection, int depth, RadianceSplit *split, float weight) const;
+    // only needed by path tracing, iterative integrator starting from an already intersected ray,
+    // split also receives the radiance if it is given
+    template <bool isBVH>
+    Vector3f tracePath(const Ray &cameraRay, const Intersection &cameraHit, int depth, RadianceSplit *split) const;
+
+    // only needed by path tracing, pdf is in area measure over all emitting objects,
+    // false if the scene has no emitting objects (e.g. point lights only)
+    bool sampleLight(Intersection &position, float &pdf) const;
+    // only needed by path tracing, pdf of sampleLight for a point found by other means
+    float getLightPdf() const { return (emissionArea > 0) ? 1.0f / emissionArea : 0.0f; }
+    // only needed by path tracing, probability that a light sample goes to the emitting objects
+    // instead of the point lights, it stays a weight on the area lighting like before
+    float getAreaLightShare() const { return lights.empty() ? 1.0f : 1.0f - POINT_LIGHT_RATIO; }
 
-    void sampleLight(Intersection &position, float &pdf) const; // only needed by path tracing
+friend class WavefrontIntegrator;
 };
@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hpp"
+
+
+RenderServer::RenderServer(const Scene &_scene, const Config &_config, const std::string &_socketPath)
+    : scene(_scene), config(_config), socketPath(_socketPath), listener(-1), stopping(false) {
+    threadCount = config.threadsX * config.threadsY;
+    for (int i = 0; i < threadCount; ++i)
+        workers.emplace_back(&RenderServer::work, this, i);
+}
+
+RenderServer::~RenderServer() {
+    {
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        stopping = true;
+    }
+    schedulerCondition.notify_all();
+    for (auto &worker: workers)
+        worker.join();
+    if (listener >= 0) {
+        close(listener);
+        unlink(socketPath.c_str());
+    }
+}
+
+bool RenderServer::run() {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+        return false;
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        return false;
+    unlink(socketPath.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+        return false;
+    std::cout << "Render server listening on " << socketPath << std::endl;
+
+    // one thread per client, the rendering itself happens on the shared pool
+    while (true) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        std::thread(&RenderServer::serve, this, connection).detach();
+    }
+}
+
+void RenderServer::work(int shard) {
+    while (true) {
+        std::shared_ptr<Job> job;
+        uint32_t tile;
+        {
+            std::unique_lock<std::mutex> lock(schedulerMutex);
+            schedulerCondition.wait(lock, [this]() { return stopping || !running.empty(); });
+            if (stopping)
+                return;
+            // round robin, a job goes to the back after giving away one tile
+            job = running.front();
+            running.pop_front();
+            tile = job->nextTile++;
+            if (job->nextTile < job->tileCount)
+                running.push_back(job);
+            else
+                admit();
+        }
+
+        uint32_t width = job->camera.width, height = job->camera.height;
+        uint32_t x0 = (tile % job->tilesX) * SERVER_TILE_SIZE, y0 = (tile / job->tilesX) * SERVER_TILE_SIZE;
+        job->tracer.renderTile(scene, job->camera, y0, std::min<uint32_t>(y0 + SERVER_TILE_SIZE, height),
+                               x0, std::min<uint32_t>(x0 + SERVER_TILE_SIZE, width),
+                               job->samples, nullptr, *job->progress, shard);
+
+        bool isDone;
+        {
+            std::lock_guard<std::mutex> lock(schedulerMutex);
+            isDone = ++job->finishedTiles == job->tileCount;
+        }
+        if (isDone)
+            doneCondition.notify_all();
+    }
+}
+
+void RenderServer::admit() {
+    // called with schedulerMutex held
+    bool isAdmitted = false;
+    while (!queued.empty() && running.size() < SERVER_MAX_JOBS) {
+        running.push_back(queued.front());
+        queued.pop_front();
+        isAdmitted = true;
+    }
+    if (isAdmitted)
+        schedulerCondition.notify_all();
+}
+
+void RenderServer::cancel(const std::shared_ptr<Job> &job) {
+    // hand out no more tiles and wait for the ones in flight, the workers still reference the job
+    std::unique_lock<std::mutex> lock(schedulerMutex);
+    running.erase(std::remove(running.begin(), running.end(), job), running.end());
+    queued.erase(std::remove(queued.begin(), queued.end(), job), queued.end());
+    job->tileCount = job->nextTile;
+    admit();
+    doneCondition.wait(lock, [&job]() { return job->finishedTiles == job->tileCount; });
+}
+
+void RenderServer::serve(int connection) {
+    std::string buffer;
+    char chunk[4096];
+    while (true) {
+        size_t newline;
+        while ((newline = buffer.find('\n')) == std::string::npos) {
+            ssize_t received = recv(connection, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                close(connection);
+                return;
+            }
+            buffer.append(chunk, received);
+        }
+        std::string request = buffer.substr(0, newline);
+        buffer.erase(0, newline + 1);
+
+        std::shared_ptr<Job> job = std::make_shared<Job>(config.getCamera(), config.getSamples());
+        config.configure(job->tracer);
+        std::string error;
+        if (!parseJob(request, *job, error)) {
+            if (!sendAll(connection, "error " + error + "\n"))
+                break;
+            continue;
+        }
+        uint32_t width = job->camera.width, height = job->camera.height;
+        job->tracer.reset(job->camera);
+        job->tilesX = (width + SERVER_TILE_SIZE - 1) / SERVER_TILE_SIZE;
+        job->tileCount = job->tilesX * ((height + SERVER_TILE_SIZE - 1) / SERVER_TILE_SIZE);
+        job->progress.reset(new Progress(uint64_t(width) * height, threadCount));
+        {
+            std::lock_guard<std::mutex> lock(schedulerMutex);
+            queued.push_back(job);
+            admit();
+        }
+
+        // report progress until the last tile is finished
+        bool isConnected = true;
+        std::unique_lock<std::mutex> lock(schedulerMutex);
+        while (job->finishedTiles < job->tileCount) {
+            doneCondition.wait_for(lock, std::chrono::milliseconds(PROGRESS_INTERVAL_MS));
+            if (job->finishedTiles == job->tileCount)
+                break;
+            lock.unlock();
+            isConnected = sendAll(connection, "progress " + std::to_string(job->progress->processed() / double(width * height)) + "\n");
+            lock.lock();
+            if (!isConnected)
+                break;
+        }
+        lock.unlock();
+        if (!isConnected) {
+            cancel(job);
+            break;
+        }
+
+        std::string image = encode(*job);
+        if (!sendAll(connection, "result " + job->format + " " + std::to_string(image.size()) + "\n" + image))
+            break;
+    }
+    close(connection);
+}
+
+bool RenderServer::parseJob(const std::string &request, Job &job, std::string &error) {
+    int width = job.camera.width, height = job.camera.height;
+    double fov = job.camera.fov;
+    Vector3f eye = job.camera.eye, front = job.camera.front, up = job.camera.up;
+    std::istringstream stream(request);
+    std::string token;
+    while (stream >> token) {
+        size_t equal = token.find('=');
+        std::string key = token.substr(0, equal);
+        std::string value = (equal == std::string::npos) ? "" : token.substr(equal + 1);
+        Vector3f *vector = (key == "eye") ? &eye : (key == "front") ? &front : (key == "up") ? &up : nullptr;
+        bool isValid = true;
+        if (key == "width") {
+            isValid = std::sscanf(value.c_str(), "%d", &width) == 1 && width > 0 && width <= 16384;
+        } else if (key == "height") {
+            isValid = std::sscanf(value.c_str(), "%d", &height) == 1 && height > 0 && height <= 16384;
+        } else if (key == "fov") {
+            isValid = std::sscanf(value.c_str(), "%lf", &fov) == 1 && fov > 0 && fov < 180;
+        } else if (key == "spp") {
+            isValid = std::sscanf(value.c_str(), "%u", &job.samples) == 1 && job.samples > 0;
+        } else if (vector != nullptr) {
+            isValid = std::sscanf(value.c_str(), "%f,%f,%f", &vector->x, &vector->y, &vector->z) == 3;
+        } else if (key == "integrator") {
+            RayTracer::Integrator integrator;
+            isValid = RayTracer::parseIntegrator(value, integrator);
+            if (isValid)
+                job.tracer.setIntegrator(integrator);
+        } else if (key == "format") {
+            job.format = value;
+            isValid = value == "ppm" || value == "pfm";
+        } else {
+            isValid = false;
+        }
+        if (!isValid) {
+            error = "invalid " + token;
+            return false;
+        }
+    }
+    // a degenerate camera would take the whole server down, not only this job
+    if (!Camera::isValidOrientation(front, up)) {
+        error = "invalid front";
+        return false;
+    }
+    job.camera = Camera(width, height, fov, eye, normalize(front), normalize(up));
+    return true;
+}
+
+std::string RenderServer::encode(Job &job) {
+    int width = job.camera.width, height = job.camera.height;
+    std::vector<Eigen::Vector3f> radiance = job.tracer.resolve();
+    std::string image;
+    if (job.format == "pfm") {
+        // little-endian PFM, rows are stored from bottom to top
+        image = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+        for (int j = height - 1; j >= 0; --j) {
+            for (int i = 0; i < width; ++i) {
+                const Eigen::Vector3f &color = radiance[j * width + i];
+                image.append(reinterpret_cast<const char *>(color.data()), 3 * sizeof(float));
+            }
+        }
+    } else {
+        image = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        for (const Eigen::Vector3f &pixel: radiance) {
+            Eigen::Vector3f color = RayTracer::toneMap(pixel);
+            image += char(uint8_t(color.x() + 0.5f));
+            image += char(uint8_t(color.y() + 0.5f));
+            image += char(uint8_t(color.z() + 0.5f));
+        }
+    }
+    return image;
+}
+
+bool RenderServer::sendAll(int connection, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(connection, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool RenderServer::submit(const std::string &socketPath, const std::string &request, const std::string &outputFilename) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketPath.size() >= sizeof(address.sun_path) || connection < 0) {
+        std::cerr << "Cannot connect to " << socketPath << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+    if (connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || !sendAll(connection, request + "\n")) {
+        std::cerr << "Cannot connect to " << socketPath << std::endl;
+        close(connection);
+        return false;
+    }
+
+    std::string buffer;
+    char chunk[4096];
+    size_t imageSize = 0;
+    bool isResult = false;
+    while (true) {
+        size_t newline = buffer.find('\n');
+        if (isResult && buffer.size() >= imageSize) {
+            std::ofstream file(outputFilename, std::ios::binary);
+            file.write(buffer.data(), imageSize);
+            close(connection);
+            std::cout << std::endl;
+            return bool(file);
+        } else if (!isResult && newline != std::string::npos) {
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            double progress;
+            char format[8];
+            if (std::sscanf(line.c_str(), "progress %lf", &progress) == 1) {
+                std::cout << "\rProgress: " << int(progress * 100) << " %" << std::flush;
+            } else if (std::sscanf(line.c_str(), "result %7s %zu", format, &imageSize) == 2) {
+                isResult = true;
+            } else {
+                std::cerr << "Render server: " << line << std::endl;
+                close(connection);
+                return false;
+            }
+            continue;
+        }
+        ssize_t received = recv(connection, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            std::cerr << "Render server closed the connection" << std::endl;
+            close(connection);
+            return false;
+        }
+        buffer.append(chunk, received);
+    }
+}
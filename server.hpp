@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vector.hpp"
+#include "global.hpp"
+#include "scene.hpp"
+#include "camera.hpp"
+#include "raytracer.hpp"
+#include "progress.hpp"
+#include "config.hpp"
+
+
+/*
+Render Server implementation
+CORE:
+- resident scene and accelerators, render jobs arrive over a Unix domain socket
+- one shared worker pool, the tiles of running jobs are handed out round robin
+- progress and results are streamed back to the client
+
+NOTE:
+- a job is one line of key=value pairs, every key is optional and defaults to the configuration of the server, e.g.
+  "width=256 height=256 fov=40 spp=16 integrator=path eye=278,273,-800 front=0,0,1 up=0,1,0 format=ppm"
+- the server answers with "progress <fraction>" lines, then "result <format> <bytes>" followed by the image
+  (8-bit PPM or float PFM), or "error <message>"
+- at most SERVER_MAX_JOBS jobs share the pool at a time, later ones wait in order
+*/
+class RenderServer {
+private:
+    struct Job {
+        Camera camera;
+        uint32_t samples;
+        std::string format;
+        RayTracer tracer;
+        std::unique_ptr<Progress> progress;
+        uint32_t tilesX, tileCount;
+        uint32_t nextTile = 0, finishedTiles = 0;   // guarded by schedulerMutex
+
+        Job(const Camera &_camera, uint32_t _samples): camera(_camera), samples(_samples), format("ppm") {}
+    };
+
+    const Scene &scene;
+    const Config &config;                           // defaults of every job
+    std::string socketPath;
+    int listener;
+    int threadCount;
+    std::vector<std::thread> workers;
+
+    std::mutex schedulerMutex;
+    std::condition_variable schedulerCondition;     // signalled when a job is queued or the server stops
+    std::condition_variable doneCondition;          // signalled when a job finishes
+    std::deque<std::shared_ptr<Job>> running;       // jobs with tiles left to hand out
+    std::deque<std::shared_ptr<Job>> queued;        // jobs waiting for a place among the running ones
+    bool stopping;
+
+public:
+    RenderServer(const Scene &_scene, const Config &_config, const std::string &_socketPath);
+    ~RenderServer();
+
+    // accept connections until the process is stopped, false if the socket cannot be opened
+    bool run();
+
+    // client side, send one job and write the result to outputFilename
+    static bool submit(const std::string &socketPath, const std::string &request, const std::string &outputFilename);
+
+private:
+    void work(int shard);
+    void serve(int connection);
+    void admit();
+    void cancel(const std::shared_ptr<Job> &job);
+
+    static bool parseJob(const std::string &request, Job &job, std::string &error);
+    static std::string encode(Job &job);
+    static bool sendAll(int connection, const std::string &data);
+};
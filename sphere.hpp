@@ -19,6 +19,8 @@ public:
     Sphere(const Vector3f &c, const float &r, Material *m = new Material(), std::string _name="sphere")
         : Object(m, _name), center(c), radius(r), radius2(r * r), area(4 * MY_PI *r *r) {}
     
+    Object *clone() const override { return new Sphere(*this); }
+
     AABB getBoundingBox() override {
         return AABB(Vector3f(center.x-radius, center.y-radius, center.z-radius),
                     Vector3f(center.x+radius, center.y+radius, center.z+radius));
@@ -51,7 +53,9 @@ public:
     }
     
     void sample(Intersection &position, float &pdf) override {
-        float theta = 2.0 * MY_PI * getRandomFloat(), phi = MY_PI * getRandomFloat();
+        float u, v;
+        getRandom2D(u, v);
+        float theta = 2.0 * MY_PI * u, phi = MY_PI * v;
         Vector3f dir(std::cos(phi), std::sin(phi)*std::cos(theta), std::sin(phi)*std::sin(theta));
         position.coordinate = center + radius * dir;
         position.normal = dir;
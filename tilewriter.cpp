@@ -0,0 +1,67 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tilewriter.hpp"
+#include "raytracer.hpp"
+
+
+TileWriter::TileWriter(int _width, int _height, const std::string &floatFilename, const std::string &byteFilename)
+    : width(_width), height(_height), floatFile(-1), byteFile(-1), floatHeaderSize(0), byteHeaderSize(0) {
+    if (!floatFilename.empty()) {
+        // little-endian PFM, rows are stored from bottom to top
+        std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+        floatFile = open(floatFilename, header, size_t(width) * height * 3 * sizeof(float), floatHeaderSize);
+    }
+    if (!byteFilename.empty()) {
+        std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        byteFile = open(byteFilename, header, size_t(width) * height * 3, byteHeaderSize);
+    }
+}
+
+TileWriter::~TileWriter() {
+    if (floatFile >= 0)
+        close(floatFile);
+    if (byteFile >= 0)
+        close(byteFile);
+}
+
+int TileWriter::open(const std::string &filename, const std::string &header, size_t dataSize, size_t &headerSize) {
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    headerSize = header.size();
+    if (pwrite(fd, header.data(), header.size(), 0) != ssize_t(header.size()) || ftruncate(fd, headerSize + dataSize) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool TileWriter::write(uint32_t x0, uint32_t y0, uint32_t tileWidth, uint32_t tileHeight, const std::vector<Eigen::Vector3f> &tile) {
+    bool isWritten = true;
+    std::vector<float> floatRow(tileWidth * 3);
+    std::vector<uint8_t> byteRow(tileWidth * 3);
+    for (uint32_t j = 0; j < tileHeight; ++j) {
+        const Eigen::Vector3f *row = tile.data() + j * tileWidth;
+        if (floatFile >= 0) {
+            for (uint32_t i = 0; i < tileWidth; ++i) {
+                floatRow[i * 3 + 0] = row[i].x();
+                floatRow[i * 3 + 1] = row[i].y();
+                floatRow[i * 3 + 2] = row[i].z();
+            }
+            size_t offset = floatHeaderSize + ((size_t(height) - 1 - (y0 + j)) * width + x0) * 3 * sizeof(float);
+            isWritten &= pwrite(floatFile, floatRow.data(), floatRow.size() * sizeof(float), offset) == ssize_t(floatRow.size() * sizeof(float));
+        }
+        if (byteFile >= 0) {
+            for (uint32_t i = 0; i < tileWidth; ++i) {
+                Eigen::Vector3f color = RayTracer::toneMap(row[i]);
+                byteRow[i * 3 + 0] = uint8_t(color.x() + 0.5f);
+                byteRow[i * 3 + 1] = uint8_t(color.y() + 0.5f);
+                byteRow[i * 3 + 2] = uint8_t(color.z() + 0.5f);
+            }
+            size_t offset = byteHeaderSize + ((size_t(y0) + j) * width + x0) * 3;
+            isWritten &= pwrite(byteFile, byteRow.data(), byteRow.size(), offset) == ssize_t(byteRow.size());
+        }
+    }
+    return isWritten;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Eigen>
+
+#include "vector.hpp"
+#include "global.hpp"
+
+
+/*
+Tile Writer implementation
+CORE:
+- streaming finished tiles to disk while the rest of the image renders
+- float output (PFM) and 8-bit output (PPM)
+
+NOTE:
+- both files are sized up front and every tile row lands at a fixed offset by positioned writes,
+  so tiles can arrive in any order from any thread and nothing else is kept in memory
+*/
+class TileWriter {
+private:
+    int width, height;
+    int floatFile;              // file descriptor, -1 if not written
+    int byteFile;               // file descriptor, -1 if not written
+    size_t floatHeaderSize, byteHeaderSize;
+
+public:
+    TileWriter(int _width, int _height, const std::string &floatFilename, const std::string &byteFilename);
+    ~TileWriter();
+
+    bool isOpen() const { return floatFile >= 0 || byteFile >= 0; }
+
+    // tile holds linear radiance of the rectangle [x0, x0 + tileWidth) x [y0, y0 + tileHeight) in row-major order
+    bool write(uint32_t x0, uint32_t y0, uint32_t tileWidth, uint32_t tileHeight, const std::vector<Eigen::Vector3f> &tile);
+
+private:
+    int open(const std::string &filename, const std::string &header, size_t dataSize, size_t &headerSize);
+};
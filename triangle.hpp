@@ -1,11 +1,11 @@
 #pragma once
 
 #include <cstring>
-#include <cassert>
 #include <array>
+#include <stdexcept>
 
 #include "object.hpp"
-#include "OBJ_loader.hpp"
+#include "objloader.hpp"
 
 
 bool rayTriangleIntersect(const Vector3f &v0, const Vector3f &v1, const Vector3f &v2, 
@@ -62,6 +62,8 @@ public:
         area = crossProduct(e1, e2).norm() * 0.5f;
     }
 
+    Object *clone() const override { return new Triangle(*this); }
+
     AABB getBoundingBox() override {
         return unite(AABB(v0, v1), v2);
     }
@@ -88,7 +90,9 @@ public:
     }
 
     void sample(Intersection &position, float &pdf) override {
-        float x = std::sqrt(getRandomFloat()), y = getRandomFloat();
+        float x, y;
+        getRandom2D(x, y);
+        x = std::sqrt(x);
         position.coordinate = v0 * (1.0f - x) + v1 * (x * (1.0f - y)) + v2 * (x * y);
         position.normal = this->normal;
         position.material = material;
@@ -111,62 +115,72 @@ private:
     float area;
     AABB boundingBox;
 
-    BVH *bvh;                           // only needed by BVH acceleration
+    BVH *bvh = nullptr;                 // only needed by BVH acceleration, owned by the mesh
 
 public:
     MeshTriangle(const std::string &filename, Material *m = new Material(), std::string _name="mesh"): Object(m, _name) {
-        objl::Loader loader;
-        loader.LoadFile(filename);
+        OBJLoader loader;
+        std::string error;
+        if (!loader.load(filename, error))
+            throw std::runtime_error(error);
+        if (loader.getTriangleCount() == 0)
+            throw std::runtime_error(filename + ": no faces");
 
         area = 0;
 
-        assert(loader.LoadedMeshes.size() == 1);
-        auto mesh = loader.LoadedMeshes[0];
-
         Vector3f min_vert = Vector3f{std::numeric_limits<float>::infinity(),
                                      std::numeric_limits<float>::infinity(),
                                      std::numeric_limits<float>::infinity()};
         Vector3f max_vert = Vector3f{-std::numeric_limits<float>::infinity(),
                                      -std::numeric_limits<float>::infinity(),
                                      -std::numeric_limits<float>::infinity()};
-        for (int i = 0; i < mesh.Vertices.size(); i += 3) {
-            std::array<Vector3f, 3> face_vertices;
-
-            for (int j = 0; j < 3; j++) {
-                auto vert = Vector3f(mesh.Vertices[i + j].Position.X,
-                                     mesh.Vertices[i + j].Position.Y,
-                                     mesh.Vertices[i + j].Position.Z);
-                face_vertices[j] = vert;
-
-                min_vert = Vector3f(std::min(min_vert.x, vert.x),
-                                    std::min(min_vert.y, vert.y),
-                                    std::min(min_vert.z, vert.z));
-                max_vert = Vector3f(std::max(max_vert.x, vert.x),
-                                    std::max(max_vert.y, vert.y),
-                                    std::max(max_vert.z, vert.z));
-            }
+        // all objects of the file form one mesh, the triangles of named objects carry their names
+        triangles.reserve(loader.getTriangleCount());
+        for (const OBJLoader::Object &object: loader.objects) {
+            std::string prefix = object.name.empty() ? _name + "_triangle_" : _name + "_" + object.name + "_triangle_";
+            for (uint32_t i = 0; i < object.triangleCount; ++i) {
+                std::array<Vector3f, 3> face_vertices;
+
+                for (int j = 0; j < 3; j++) {
+                    auto vert = loader.positions[loader.indices[(object.firstTriangle + i) * 3 + j]];
+                    face_vertices[j] = vert;
+
+                    min_vert = Vector3f(std::min(min_vert.x, vert.x),
+                                        std::min(min_vert.y, vert.y),
+                                        std::min(min_vert.z, vert.z));
+                    max_vert = Vector3f(std::max(max_vert.x, vert.x),
+                                        std::max(max_vert.y, vert.y),
+                                        std::max(max_vert.z, vert.z));
+                }
 
-            triangles.emplace_back(face_vertices[0], face_vertices[1],
-                                   face_vertices[2], m, _name + "_triangle_" + std::to_string(i / 3));
+                triangles.emplace_back(face_vertices[0], face_vertices[1],
+                                       face_vertices[2], m, prefix + std::to_string(i));
+            }
         }
 
         boundingBox = AABB(min_vert, max_vert);
 
-        std::vector<Object *> ptrs;
-        for (auto &tri: triangles) {
-            ptrs.push_back(&tri);
+        for (auto &tri: triangles)
             area += tri.area;
-        }
-        if (!IS_BVH) {
-            bvh = nullptr;
-        } else {
-            if (!IS_SAH)
-                bvh = new BVH(ptrs, BVH::SplitMethod::NAIVE);
-            else
-                bvh = new BVH(ptrs, BVH::SplitMethod::SAH);
-        }
+        buildBVH();
     }
 
+    MeshTriangle(const MeshTriangle &mesh): Object(mesh), triangles(mesh.triangles), area(mesh.area), boundingBox(mesh.boundingBox) {
+        // the copied triangles need their own BVH, the original one points into the other mesh
+        buildBVH();
+    }
+    MeshTriangle &operator=(const MeshTriangle &) = delete;
+    ~MeshTriangle() override { delete bvh; }
+
+    void setId(uint32_t _id) override {
+        // a hit reports the triangle, so it carries the id of the mesh
+        id = _id;
+        for (auto &tri: triangles)
+            tri.id = _id;
+    }
+
+    Object *clone() const override { return new MeshTriangle(*this); }
+
     AABB getBoundingBox() override {
         return boundingBox;
     }
@@ -219,4 +233,19 @@ public:
             bvh->sample(position, pdf);
         }
     }
+
+private:
+    void buildBVH() {
+        if (!IS_BVH) {
+            bvh = nullptr;
+            return;
+        }
+        std::vector<Object *> ptrs;
+        for (auto &tri: triangles)
+            ptrs.push_back(&tri);
+        if (!IS_SAH)
+            bvh = new BVH(ptrs, BVH::SplitMethod::NAIVE);
+        else
+            bvh = new BVH(ptrs, BVH::SplitMethod::SAH);
+    }
 };
@@ -0,0 +1,343 @@
+#include <algorithm>
+
+#include "wavefront.hpp"
+
+
+void WavefrontIntegrator::PathStates::resize(size_t n) {
+    originX.resize(n); originY.resize(n); originZ.resize(n);
+    directionX.resize(n); directionY.resize(n); directionZ.resize(n);
+    throughputR.resize(n); throughputG.resize(n); throughputB.resize(n);
+    slot.resize(n);
+    pixel.resize(n); sample.resize(n);
+    depth.resize(n);
+    isIndirect.resize(n);
+    bsdfPdf.resize(n);
+    hitX.resize(n); hitY.resize(n); hitZ.resize(n);
+    normalX.resize(n); normalY.resize(n); normalZ.resize(n);
+    distance.resize(n);
+    material.resize(n);
+    queue.resize(n);
+}
+
+void WavefrontIntegrator::PathStates::set(size_t i, const Ray &ray, const Vector3f &throughput, uint32_t _slot, uint32_t _pixel,
+                                          uint32_t _sample, uint16_t _depth, uint8_t _isIndirect) {
+    setRay(i, ray);
+    setThroughput(i, throughput);
+    slot[i] = _slot;
+    pixel[i] = _pixel;
+    sample[i] = _sample;
+    depth[i] = _depth;
+    isIndirect[i] = _isIndirect;
+    bsdfPdf[i] = 0.0f;
+}
+
+void WavefrontIntegrator::PathStates::move(size_t from, size_t to) {
+    originX[to] = originX[from]; originY[to] = originY[from]; originZ[to] = originZ[from];
+    directionX[to] = directionX[from]; directionY[to] = directionY[from]; directionZ[to] = directionZ[from];
+    throughputR[to] = throughputR[from]; throughputG[to] = throughputG[from]; throughputB[to] = throughputB[from];
+    slot[to] = slot[from];
+    pixel[to] = pixel[from]; sample[to] = sample[from];
+    depth[to] = depth[from];
+    isIndirect[to] = isIndirect[from];
+    bsdfPdf[to] = bsdfPdf[from];
+}
+
+void WavefrontIntegrator::PathStates::setRay(size_t i, const Ray &ray) {
+    originX[i] = ray.origin.x; originY[i] = ray.origin.y; originZ[i] = ray.origin.z;
+    directionX[i] = ray.direction.x; directionY[i] = ray.direction.y; directionZ[i] = ray.direction.z;
+}
+
+void WavefrontIntegrator::PathStates::setThroughput(size_t i, const Vector3f &throughput) {
+    throughputR[i] = throughput.x; throughputG[i] = throughput.y; throughputB[i] = throughput.z;
+}
+
+void WavefrontIntegrator::PathStates::setHit(size_t i, const Intersection &intersection) {
+    hitX[i] = intersection.coordinate.x; hitY[i] = intersection.coordinate.y; hitZ[i] = intersection.coordinate.z;
+    normalX[i] = intersection.normal.x; normalY[i] = intersection.normal.y; normalZ[i] = intersection.normal.z;
+    distance[i] = intersection.distance;
+    material[i] = intersection.happened ? intersection.material : nullptr;
+}
+
+void WavefrontIntegrator::ShadowRays::clear() {
+    originX.clear(); originY.clear(); originZ.clear();
+    directionX.clear(); directionY.clear(); directionZ.clear();
+    distance.clear();
+    contributionR.clear(); contributionG.clear(); contributionB.clear();
+    slot.clear();
+}
+
+void WavefrontIntegrator::ShadowRays::push(const Vector3f &origin, const Vector3f &direction, float _distance,
+                                           const Vector3f &contribution, uint32_t _slot) {
+    originX.push_back(origin.x); originY.push_back(origin.y); originZ.push_back(origin.z);
+    directionX.push_back(direction.x); directionY.push_back(direction.y); directionZ.push_back(direction.z);
+    distance.push_back(_distance);
+    contributionR.push_back(contribution.x); contributionG.push_back(contribution.y); contributionB.push_back(contribution.z);
+    slot.push_back(_slot);
+}
+
+void WavefrontIntegrator::trace(const std::vector<CameraSample> &samples, std::vector<Vector3f> &radianceOut,
+                                std::vector<Intersection> *primaryOut) {
+    radianceOut.assign(samples.size(), Vector3f(0.0f));
+    radiance = &radianceOut;
+    primary = primaryOut;
+    if (primary != nullptr)
+        primary->resize(samples.size());
+
+    // the traversal kernels are specialized for the accelerator once per wave
+    bool isBVH = scene.isBVH();
+    generate(samples);
+    while (paths.size() > 0) {
+        isBVH ? intersect<true>() : intersect<false>();
+        std::array<size_t, QUEUE_COUNT + 1> begin = sortByMaterial();
+        isAlive.assign(paths.size(), 1);
+        shadowRays.clear();
+
+        shadeMiss(begin[QUEUE_MISS], begin[QUEUE_MISS + 1]);
+        shadeDiffuse(begin[QUEUE_DIFFUSE], begin[QUEUE_DIFFUSE + 1]);
+        shadeSpecular(begin[QUEUE_REFLECTION], begin[QUEUE_REFLECTION + 1], REFLECTION);
+        shadeSpecular(begin[QUEUE_REFRACTION], begin[QUEUE_REFRACTION + 1], REFRACTION);
+        shadeReflectionAndRefraction(begin[QUEUE_REFLECTION_AND_REFRACTION], begin[QUEUE_REFLECTION_AND_REFRACTION + 1]);
+        shadeEmission(begin[QUEUE_EMISSION], begin[QUEUE_EMISSION + 1]);
+
+        isBVH ? traceShadowRays<true>() : traceShadowRays<false>();
+        compact();
+    }
+    radiance = nullptr;
+    primary = nullptr;
+}
+
+void WavefrontIntegrator::generate(const std::vector<CameraSample> &samples) {
+    paths.resize(samples.size());
+    for (uint32_t k = 0; k < samples.size(); ++k) {
+        const CameraSample &s = samples[k];
+        Vector2f offset(0.0f, 0.0f);
+        if (camera.isJitter) {
+            seedRandom(s.x, s.y, s.index);
+            offset = camera.samplePixel();
+        }
+        paths.set(k, camera.generateRay(s.x, s.y, offset), Vector3f(1.0f), k, s.y * camera.width + s.x, s.index, 0, 0);
+    }
+}
+
+template <bool isBVH>
+void WavefrontIntegrator::intersect() {
+    size_t n = paths.size();
+    Intersection hit;
+    for (size_t i = 0; i < n; ++i) {
+        // without jitter the camera rays of a pixel are identical, generate pushes them next to each other
+        // so only the first one is traced and the others keep its hit
+        if (camera.isJitter || i == 0 || paths.depth[i] != 0 || paths.depth[i - 1] != 0 || paths.pixel[i] != paths.pixel[i - 1])
+            hit = scene.intersect<isBVH>(paths.getRay(i));
+        paths.setHit(i, hit);
+        if (primary != nullptr && paths.depth[i] == 0)
+            (*primary)[paths.slot[i]] = hit;
+        if (!hit.happened) {
+            paths.queue[i] = QUEUE_MISS;
+        } else {
+            switch (hit.material->getType()) {
+                case DIFFUSE: paths.queue[i] = QUEUE_DIFFUSE; break;
+                case REFLECTION: paths.queue[i] = QUEUE_REFLECTION; break;
+                case REFRACTION: paths.queue[i] = QUEUE_REFRACTION; break;
+                case REFLECTION_AND_REFRACTION: paths.queue[i] = QUEUE_REFLECTION_AND_REFRACTION; break;
+                case EMISSION: paths.queue[i] = QUEUE_EMISSION; break;
+                default: throw std::runtime_error("Unsupported material type.");
+            }
+        }
+    }
+}
+
+std::array<size_t, WavefrontIntegrator::QUEUE_COUNT + 1> WavefrontIntegrator::sortByMaterial() {
+    std::array<size_t, QUEUE_COUNT + 1> begin = {};
+    size_t n = paths.size();
+    for (size_t i = 0; i < n; ++i)
+        ++begin[paths.queue[i] + 1];
+    for (int q = 0; q < QUEUE_COUNT; ++q)
+        begin[q + 1] += begin[q];
+
+    std::array<size_t, QUEUE_COUNT + 1> cursor = begin;
+    order.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        order[cursor[paths.queue[i]]++] = uint32_t(i);
+    return begin;
+}
+
+void WavefrontIntegrator::shadeMiss(size_t begin, size_t end) {
+    // only camera and specular rays receive the background, indirect rays which miss are terminated
+    for (size_t k = begin; k < end; ++k) {
+        size_t i = order[k];
+        if (!paths.isIndirect[i])
+            (*radiance)[paths.slot[i]] += paths.getThroughput(i) * scene.backgroundColor;
+        isAlive[i] = 0;
+    }
+}
+
+void WavefrontIntegrator::shadeDiffuse(size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) {
+        size_t i = order[k];
+        Material *material = paths.material[i];
+        Vector3f hitCoordinate = paths.getHitCoordinate(i);
+        Vector3f hitNormal = paths.getHitNormal(i);
+        Ray ray = paths.getRay(i);
+        Vector3f throughput = paths.getThroughput(i);
+        resumeRandom(i);
+
+        Vector3f hitPointOrig = (dotProduct(ray.direction, hitNormal) < 0) ?
+                                hitCoordinate + hitNormal * epsilon2 :
+                                hitCoordinate - hitNormal * epsilon2;
+
+        // sample on light, the visibility test is deferred to the shadow ray kernel
+        startRandomDimension(paths.depth[i], DIMENSION_LIGHT);
+        bool isPointLight = getRandomFloat() <= POINT_LIGHT_RATIO;
+        if (isPointLight && scene.lights.size() > 0) {
+            // point light
+            int lightIndex = getRandomInt(0, scene.lights.size() - 1);
+            auto &light = scene.lights[lightIndex];
+            Vector3f lightDir = light->position - hitPointOrig;
+            float lightDistance2 = dotProduct(lightDir, lightDir);
+            lightDir = normalize(lightDir);
+            Vector3f LDir = light->intensity * material->brdf(ray.direction, lightDir, hitNormal)
+                            * dotProduct(lightDir, hitNormal) / lightDistance2;
+            shadowRays.push(hitPointOrig, lightDir, std::sqrt(lightDistance2), throughput * LDir, paths.slot[i]);
+        } else {
+            // area light
+            Intersection lightSample;
+            float lightPdf = 0.0;
+            if (scene.sampleLight(lightSample, lightPdf)) {
+                Vector3f lightDir = lightSample.coordinate - hitPointOrig;
+                float lightDistance2 = dotProduct(lightDir, lightDir);
+                lightDir = normalize(lightDir);
+                float cosLight = dotProduct(-lightDir, lightSample.normal);
+                if (cosLight > 0) {
+                    // multiple importance sampling with the BSDF sample, which shadeEmission weights,
+                    // the last vertex takes no BSDF sample so the light sample keeps its full weight
+                    float weight = (paths.depth[i] + 1 > scene.maxDepth) ? 1.0f :
+                                   powerHeuristic(scene.getAreaLightShare() * lightPdf * lightDistance2 / cosLight,
+                                                  material->pdf(ray.direction, lightDir, hitNormal));
+                    Vector3f LDir = lightSample.material->intensity * material->brdf(ray.direction, lightDir, hitNormal)
+                                    * dotProduct(lightDir, hitNormal) * cosLight / lightDistance2 / lightPdf * weight;
+                    shadowRays.push(hitPointOrig, lightDir, std::sqrt(lightDistance2), throughput * LDir, paths.slot[i]);
+                }
+            }
+        }
+
+        // russian roulette, paths carrying little energy are more likely to stop
+        float survival = std::min<float>(PATH_RR, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+        startRandomDimension(paths.depth[i], DIMENSION_RR);
+        if (getRandomFloat() >= survival || paths.depth[i] + 1 > scene.maxDepth) {
+            isAlive[i] = 0;
+            continue;
+        }
+
+        // sample on hemisphere
+        startRandomDimension(paths.depth[i], DIMENSION_BSDF);
+        BSDFSample bsdf;
+        if (!material->sample(ray.direction, hitNormal, bsdf)) {
+            isAlive[i] = 0;
+            continue;
+        }
+        paths.bsdfPdf[i] = bsdf.pdf;
+        throughput = throughput * bsdf.f * dotProduct(bsdf.direction, hitNormal) / bsdf.pdf / survival;
+        paths.setRay(i, Ray(hitPointOrig, bsdf.direction));
+        paths.setThroughput(i, throughput);
+        paths.depth[i] += 1;
+        paths.isIndirect[i] = 1;
+    }
+}
+
+void WavefrontIntegrator::shadeSpecular(size_t begin, size_t end, MaterialType type) {
+    for (size_t k = begin; k < end; ++k) {
+        size_t i = order[k];
+        if (paths.depth[i] + 1 > scene.maxDepth) {
+            isAlive[i] = 0;
+            continue;
+        }
+        Vector3f hitCoordinate = paths.getHitCoordinate(i);
+        Vector3f hitNormal = paths.getHitNormal(i);
+        Ray ray = paths.getRay(i);
+        Vector3f direction = (type == REFLECTION) ?
+                             normalize(reflect(ray.direction, hitNormal)) :
+                             normalize(refract(ray.direction, hitNormal, paths.material[i]->ior));
+        Vector3f rayOrig = (dotProduct(direction, hitNormal) < 0) ?
+                           hitCoordinate - hitNormal * epsilon2 :
+                           hitCoordinate + hitNormal * epsilon2;
+        paths.setRay(i, Ray(rayOrig, direction));
+        paths.depth[i] += 1;
+        paths.isIndirect[i] = 0;
+    }
+}
+
+void WavefrontIntegrator::shadeReflectionAndRefraction(size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) {
+        size_t i = order[k];
+        if (paths.depth[i] + 1 > scene.maxDepth) {
+            isAlive[i] = 0;
+            continue;
+        }
+        Vector3f hitCoordinate = paths.getHitCoordinate(i);
+        Vector3f hitNormal = paths.getHitNormal(i);
+        Ray ray = paths.getRay(i);
+        float kr = fresnel(ray.direction, hitNormal, paths.material[i]->ior);
+
+        // same stochastic choice as the scalar path, the path keeps its slot and throughput
+        resumeRandom(i);
+        startRandomDimension(paths.depth[i], DIMENSION_FRESNEL);
+        Vector3f direction = (getRandomFloat() < kr) ?
+                             normalize(reflect(ray.direction, hitNormal)) :
+                             normalize(refract(ray.direction, hitNormal, paths.material[i]->ior));
+        Vector3f rayOrig = (dotProduct(direction, hitNormal) < 0) ?
+                           hitCoordinate - hitNormal * epsilon2 :
+                           hitCoordinate + hitNormal * epsilon2;
+        paths.setRay(i, Ray(rayOrig, direction));
+        paths.depth[i] += 1;
+        paths.isIndirect[i] = 0;
+    }
+}
+
+void WavefrontIntegrator::shadeEmission(size_t begin, size_t end) {
+    // emission reached by indirect rays is weighted against sampling on light
+    for (size_t k = begin; k < end; ++k) {
+        size_t i = order[k];
+        Vector3f emission = paths.getThroughput(i) * paths.material[i]->intensity;
+        if (!paths.isIndirect[i]) {
+            (*radiance)[paths.slot[i]] += emission;
+        } else {
+            float cosLight = -(paths.directionX[i] * paths.normalX[i] + paths.directionY[i] * paths.normalY[i]
+                               + paths.directionZ[i] * paths.normalZ[i]);
+            if (cosLight > 0) {
+                float lightPdf = scene.getAreaLightShare() * scene.getLightPdf() * paths.distance[i] * paths.distance[i] / cosLight;
+                (*radiance)[paths.slot[i]] += emission * scene.getAreaLightShare() * powerHeuristic(paths.bsdfPdf[i], lightPdf);
+            }
+        }
+        isAlive[i] = 0;
+    }
+}
+
+template <bool isBVH>
+void WavefrontIntegrator::traceShadowRays() {
+    size_t n = shadowRays.size();
+    for (size_t i = 0; i < n; ++i) {
+        Ray ray(Vector3f(shadowRays.originX[i], shadowRays.originY[i], shadowRays.originZ[i]),
+                Vector3f(shadowRays.directionX[i], shadowRays.directionY[i], shadowRays.directionZ[i]));
+        Intersection intersection = scene.intersect<isBVH>(ray);
+        bool isDir = (!intersection.happened) || (intersection.distance >= shadowRays.distance[i] - epsilon2);
+        if (isDir)
+            (*radiance)[shadowRays.slot[i]] += Vector3f(shadowRays.contributionR[i], shadowRays.contributionG[i], shadowRays.contributionB[i]);
+    }
+}
+
+void WavefrontIntegrator::compact() {
+    size_t n = paths.size();
+    size_t alive = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (isAlive[i]) {
+            if (alive != i)
+                paths.move(i, alive);
+            ++alive;
+        }
+    }
+    paths.resize(alive);
+}
+
+void WavefrontIntegrator::resumeRandom(size_t i) const {
+    seedRandom(paths.pixel[i] % camera.width, paths.pixel[i] / camera.width, paths.sample[i]);
+}
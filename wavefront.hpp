@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "vector.hpp"
+#include "global.hpp"
+#include "scene.hpp"
+#include "camera.hpp"
+#include "ray.hpp"
+#include "intersection.hpp"
+
+
+/*
+Wavefront Path Tracing implementation
+CORE:
+- path states kept in SoA buffers
+- separate kernels for ray generation, intersection, per-material shading and shadow rays
+- path indices sorted by material and the paths compacted between stages
+
+NOTE:
+- only needed by path tracing, the shading kernels follow Scene::tracePath
+- every thread keeps its own wave, WAVEFRONT_SIZE is split among the threads
+*/
+class WavefrontIntegrator {
+public:
+    struct CameraSample {
+        uint32_t x, y;          // pixel coordinate
+        uint32_t index;         // sample index of that pixel
+    };
+
+private:
+    // shading queues, a path is sorted into the queue of the material it hit
+    enum Queue { QUEUE_MISS, QUEUE_DIFFUSE, QUEUE_REFLECTION, QUEUE_REFRACTION,
+                 QUEUE_REFLECTION_AND_REFRACTION, QUEUE_EMISSION, QUEUE_COUNT };
+
+    struct PathStates {
+        std::vector<float> originX, originY, originZ;
+        std::vector<float> directionX, directionY, directionZ;
+        std::vector<float> throughputR, throughputG, throughputB;
+        std::vector<uint32_t> slot;             // index of the camera sample the path contributes to
+        std::vector<uint32_t> pixel, sample;    // random sequences of the path
+        std::vector<uint16_t> depth;
+        std::vector<uint8_t> isIndirect;        // whether the path left a diffuse surface last
+        std::vector<float> bsdfPdf;             // pdf of the direction it left that surface in
+        // only the fields of the hit the shading kernels read, rewritten by every intersection
+        std::vector<float> hitX, hitY, hitZ;
+        std::vector<float> normalX, normalY, normalZ;
+        std::vector<double> distance;
+        std::vector<Material *> material;       // nullptr if the ray missed
+        std::vector<uint8_t> queue;
+
+        size_t size() const { return slot.size(); }
+        void resize(size_t n);
+        void set(size_t i, const Ray &ray, const Vector3f &throughput, uint32_t _slot, uint32_t _pixel,
+                 uint32_t _sample, uint16_t _depth, uint8_t _isIndirect);
+        // moves the path itself, the hit is not needed any more once the path is shaded
+        void move(size_t from, size_t to);
+
+        Ray getRay(size_t i) const {
+            return Ray(Vector3f(originX[i], originY[i], originZ[i]), Vector3f(directionX[i], directionY[i], directionZ[i]));
+        }
+        Vector3f getThroughput(size_t i) const { return Vector3f(throughputR[i], throughputG[i], throughputB[i]); }
+        Vector3f getHitCoordinate(size_t i) const { return Vector3f(hitX[i], hitY[i], hitZ[i]); }
+        Vector3f getHitNormal(size_t i) const { return Vector3f(normalX[i], normalY[i], normalZ[i]); }
+        void setRay(size_t i, const Ray &ray);
+        void setThroughput(size_t i, const Vector3f &throughput);
+        void setHit(size_t i, const Intersection &intersection);
+    };
+
+    struct ShadowRays {
+        std::vector<float> originX, originY, originZ;
+        std::vector<float> directionX, directionY, directionZ;
+        std::vector<float> distance;
+        std::vector<float> contributionR, contributionG, contributionB;
+        std::vector<uint32_t> slot;
+
+        size_t size() const { return slot.size(); }
+        void clear();
+        void push(const Vector3f &origin, const Vector3f &direction, float _distance, const Vector3f &contribution, uint32_t _slot);
+    };
+
+    const Scene &scene;
+    const Camera &camera;
+
+    PathStates paths;
+    std::vector<uint32_t> order;                // path indices sorted by queue, the states themselves stay in place
+    std::vector<uint8_t> isAlive;
+    ShadowRays shadowRays;
+    std::vector<Vector3f> *radiance;
+    std::vector<Intersection> *primary;
+
+public:
+    WavefrontIntegrator(const Scene &_scene, const Camera &_camera): scene(_scene), camera(_camera), radiance(nullptr), primary(nullptr) {}
+
+    // trace all camera samples, radianceOut[i] receives the estimate of samples[i]
+    // and primaryOut[i] the camera ray hit of samples[i] if it is given
+    void trace(const std::vector<CameraSample> &samples, std::vector<Vector3f> &radianceOut,
+               std::vector<Intersection> *primaryOut = nullptr);
+
+private:
+    void generate(const std::vector<CameraSample> &samples);
+    template <bool isBVH>
+    void intersect();
+    // counting sort of the path indices into order by queue, returns the beginning of every queue in order
+    std::array<size_t, QUEUE_COUNT + 1> sortByMaterial();
+    void shadeMiss(size_t begin, size_t end);
+    void shadeDiffuse(size_t begin, size_t end);
+    void shadeSpecular(size_t begin, size_t end, MaterialType type);
+    void shadeReflectionAndRefraction(size_t begin, size_t end);
+    void shadeEmission(size_t begin, size_t end);
+    template <bool isBVH>
+    void traceShadowRays();
+    void compact();
+
+    // switch the per-thread random sequences to those of path i, the dimension follows from the depth
+    void resumeRandom(size_t i) const;
+};